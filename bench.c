@@ -0,0 +1,400 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "triggers.h"
+
+/* Rough timings of common AdamTriggers usage patterns.  Numbers are
+   wall-clock-ish (clock()) and only meaningful relative to each other. */
+
+#define NUM_ENTITIES   2000
+#define NUM_EVENTNAMES 40
+
+static const char *const eventnames[NUM_EVENTNAMES] = {
+  "dmg ", "heal", "die ", "spwn", "move", "stop", "jump", "land",
+  "fire", "rld ", "aim ", "hit ", "miss", "use ", "pick", "drop",
+  "open", "shut", "lock", "unlk", "talk", "quit", "buy ", "sell",
+  "see ", "hear", "fear", "rage", "calm", "hide", "seek", "find",
+  "lose", "win ", "save", "load", "tick", "tock", "ping", "pong"
+};
+
+
+static LFUNC_RTN
+count_callback(LFUNC_PARAM)
+{
+  ++*(unsigned long*)listener_data;
+}
+
+
+static double
+seconds(void)
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+static void
+report(const char *const what,
+       const double elapsed,
+       const unsigned long ops)
+{
+  printf("%-40s %8.3f s  %8.1f ns/op\n",
+	 what, elapsed, 1e9 * elapsed / ops);
+}
+
+
+/* each spawned entity gets a trigger and a listener; the listener
+   listens for every event type on the entity's own trigger and on a
+   shared world trigger. */
+static void
+bench_spawn_despawn(void)
+{
+  Trigger **triggers = malloc(sizeof(Trigger*) * NUM_ENTITIES);
+  Listener **listeners = malloc(sizeof(Listener*) * NUM_ENTITIES);
+  Trigger *world;
+  unsigned long count = 0;
+  double t;
+  int i, j;
+
+  /* one triggerListen() per event type */
+  world = triggerNew();
+  t = seconds();
+  for (i=0; i<NUM_ENTITIES; ++i) {
+    triggers[i] = triggerNew();
+    listeners[i] = listenerSetData(listenerNewWithFunc(count_callback),
+				   &count);
+    for (j=0; j<NUM_EVENTNAMES; ++j) {
+      triggerListen(triggers[i], eventnames[j], listeners[i]);
+      triggerListen(world, eventnames[j], listeners[i]);
+    }
+  }
+  report("spawn: triggerListen() loop", seconds() - t,
+	 NUM_ENTITIES);
+
+  t = seconds();
+  for (i=0; i<NUM_ENTITIES; ++i) {
+    for (j=0; j<NUM_EVENTNAMES; ++j) {
+      triggerUnlisten(triggers[i], eventnames[j], listeners[i]);
+      triggerUnlisten(world, eventnames[j], listeners[i]);
+    }
+    listenerDelete(listeners[i]);
+    triggerDelete(triggers[i]);
+  }
+  report("despawn: triggerUnlisten() loop", seconds() - t,
+	 NUM_ENTITIES);
+  triggerDelete(world);
+
+  /* the same again through the bulk API */
+  world = triggerNew();
+  t = seconds();
+  for (i=0; i<NUM_ENTITIES; ++i) {
+    Trigger *both[2];
+    triggers[i] = triggerNew();
+    listeners[i] = listenerSetData(listenerNewWithFunc(count_callback),
+				   &count);
+    both[0] = triggers[i];
+    both[1] = world;
+    triggerListenMulti(both, 2, eventnames[0], listeners[i]);
+    triggerListenMany(triggers[i], eventnames + 1, NUM_EVENTNAMES - 1,
+		      listeners[i]);
+    triggerListenMany(world, eventnames + 1, NUM_EVENTNAMES - 1,
+		      listeners[i]);
+  }
+  report("spawn: triggerListenMany()/Multi()", seconds() - t,
+	 NUM_ENTITIES);
+
+  t = seconds();
+  for (i=0; i<NUM_ENTITIES; ++i) {
+    listenerUnlistenAll(listeners[i]);
+    listenerDelete(listeners[i]);
+    triggerDelete(triggers[i]);
+  }
+  report("despawn: listenerUnlistenAll()", seconds() - t,
+	 NUM_ENTITIES);
+  triggerDelete(world);
+
+  free(listeners);
+  free(triggers);
+}
+
+
+/* schedule a steady stream of events at a spread of delays and tick
+   through them all. */
+static void
+bench_scheduled_events(void)
+{
+  const unsigned long num_events = 1000000;
+  const unsigned long per_tick = 100;
+  TriggerWheel *wheel = triggerWheelNew();
+  Trigger *trigger = triggerNew();
+  Listener *listener = listenerNewWithFunc(count_callback);
+  unsigned long count = 0;
+  unsigned long i;
+  double t;
+
+  listenerSetData(listener, &count);
+  triggerListen(trigger, "tick", listener);
+
+  srand(1);
+  t = seconds();
+  for (i=0; i<num_events; ++i) {
+    triggerEventAfter(wheel, trigger, "tick", &i, sizeof(i),
+		      1 + (unsigned long)rand() % 5000);
+    if (0 == i % per_tick) {
+      triggerTick(wheel);
+    }
+  }
+  while (count < num_events) {
+    triggerTick(wheel);
+  }
+  report("triggerEventAfter() + triggerTick()", seconds() - t, num_events);
+
+  triggerWheelDelete(wheel);
+  triggerDelete(trigger);
+  listenerDelete(listener);
+}
+
+
+/* build a level's worth of subscriptions the slow way, snapshot it, then
+   time rebuilding it from the snapshot. */
+static void
+bench_graph_load(void)
+{
+  const int num_triggers = 20000;
+  const int num_listeners = 20000;
+  const int listens_per_listener = 20;
+  LFunction *functions[1];
+  Trigger **triggers = malloc(sizeof(Trigger*) * num_triggers);
+  Listener **listeners = malloc(sizeof(Listener*) * num_listeners);
+  void **listener_data = malloc(sizeof(void*) * num_listeners);
+  unsigned long count = 0;
+  unsigned char *snapshot;
+  size_t snapshot_size;
+  double t;
+  int i, j;
+
+  functions[0] = count_callback;
+
+  srand(1);
+  t = seconds();
+  for (i=0; i<num_triggers; ++i) {
+    triggers[i] = triggerNew();
+  }
+  for (i=0; i<num_listeners; ++i) {
+    listener_data[i] = &count;
+    listeners[i] = listenerSetData(listenerNewWithFunc(count_callback),
+				   listener_data[i]);
+    for (j=0; j<listens_per_listener; ++j) {
+      triggerListen(triggers[rand() % num_triggers],
+		    eventnames[rand() % NUM_EVENTNAMES], listeners[i]);
+    }
+  }
+  report("graph: build with triggerListen()", seconds() - t,
+	 num_listeners * listens_per_listener);
+
+  snapshot_size = triggerGraphSave(triggers, num_triggers,
+				   listeners, num_listeners,
+				   functions, 1, NULL, 0);
+  snapshot = malloc(snapshot_size);
+  t = seconds();
+  triggerGraphSave(triggers, num_triggers, listeners, num_listeners,
+		   functions, 1, snapshot, snapshot_size);
+  report("graph: triggerGraphSave()", seconds() - t,
+	 num_listeners * listens_per_listener);
+
+  for (i=0; i<num_listeners; ++i) {
+    listenerDelete(listeners[i]);
+  }
+  for (i=0; i<num_triggers; ++i) {
+    triggerDelete(triggers[i]);
+  }
+
+  t = seconds();
+  triggerGraphLoad(snapshot, snapshot_size, functions, 1, listener_data,
+		   triggers, listeners);
+  report("graph: triggerGraphLoad()", seconds() - t,
+	 num_listeners * listens_per_listener);
+
+  for (i=0; i<num_listeners; ++i) {
+    listenerDelete(listeners[i]);
+  }
+  for (i=0; i<num_triggers; ++i) {
+    triggerDelete(triggers[i]);
+  }
+
+  free(snapshot);
+  free(listener_data);
+  free(listeners);
+  free(triggers);
+}
+
+
+/* one event type with a very large number of listeners (up to the 65535
+   that a listener list can hold), each allocated
+   amongst other clutter as it would be in a real program.  Run under
+   'perf stat -e cache-misses' to see the memory cost of each delivery. */
+static void
+bench_fan_out(void)
+{
+  const int num_listeners = 50000;
+  const int num_events = 1000;
+  Trigger *trigger = triggerNew();
+  Listener **listeners = malloc(sizeof(Listener*) * num_listeners);
+  void **clutter = malloc(sizeof(void*) * num_listeners);
+  unsigned long count = 0;
+  double t;
+  int i;
+
+  srand(1);
+  for (i=0; i<num_listeners; ++i) {
+    clutter[i] = malloc(64 + rand() % 512);
+    listeners[i] = listenerSetData(listenerNewWithFunc(count_callback),
+				   &count);
+  }
+  /* subscribe in a shuffled order, so that list order isn't
+     allocation order */
+  for (i=num_listeners-1; i>0; --i) {
+    const int j = rand() % (i + 1);
+    Listener *const swap = listeners[i];
+    listeners[i] = listeners[j];
+    listeners[j] = swap;
+  }
+  for (i=0; i<num_listeners; ++i) {
+    triggerListen(trigger, "dmg ", listeners[i]);
+  }
+
+  t = seconds();
+  for (i=0; i<num_events; ++i) {
+    triggerEvent(trigger, "dmg ", NULL);
+  }
+  report("fan-out: per delivery", seconds() - t,
+	 (unsigned long)num_events * num_listeners);
+
+  triggerDelete(trigger);
+  for (i=0; i<num_listeners; ++i) {
+    listenerDelete(listeners[i]);
+    free(clutter[i]);
+  }
+  free(clutter);
+  free(listeners);
+}
+
+
+/* events bubbling from weapon triggers up through their owners' triggers
+   to a single world trigger.  Only the weapon and the world listen, so
+   the owner level is a lookup miss every time. */
+static void
+bench_bubbling(void)
+{
+  const int num_owners = 1000;
+  const int num_events = 200;
+  Trigger *world = triggerNew();
+  Trigger **owners = malloc(sizeof(Trigger*) * num_owners);
+  Trigger **weapons = malloc(sizeof(Trigger*) * num_owners);
+  Listener *listener = listenerNewWithFunc(count_callback);
+  unsigned long count = 0;
+  double t;
+  int i, j;
+
+  listenerSetData(listener, &count);
+  triggerListenMany(world, eventnames, NUM_EVENTNAMES, listener);
+  for (i=0; i<num_owners; ++i) {
+    owners[i] = triggerNew();
+    weapons[i] = triggerNew();
+    triggerSetParent(owners[i], world);
+    triggerSetParent(weapons[i], owners[i]);
+    triggerListenMany(weapons[i], eventnames, 8, listener);
+  }
+
+  t = seconds();
+  for (j=0; j<num_events; ++j) {
+    for (i=0; i<num_owners; ++i) {
+      triggerEvent(weapons[i], eventnames[j % 8], NULL);
+    }
+  }
+  report("bubbling: weapon -> owner -> world", seconds() - t,
+	 (unsigned long)num_events * num_owners);
+
+  listenerDelete(listener);
+  for (i=0; i<num_owners; ++i) {
+    triggerDelete(weapons[i]);
+    triggerDelete(owners[i]);
+  }
+  triggerDelete(world);
+  free(weapons);
+  free(owners);
+}
+
+
+/* one event fired on every one of a crowd of entity triggers, as for an
+   explosion: a triggerEvent() loop versus triggerEventMulti().  With
+   'scattered' set there are far more triggers than fit in the cache, and
+   they're fired in a shuffled order rather than the order they were
+   allocated in, which is where triggerEventMulti()'s prefetching earns
+   its keep; with a few thousand triggers fired in order the two are
+   about the same. */
+static void
+bench_broadcast(const int num_triggers,
+		const int num_events,
+		const int scattered)
+{
+  Trigger **triggers = malloc(sizeof(Trigger*) * num_triggers);
+  Listener **listeners = malloc(sizeof(Listener*) * num_triggers);
+  unsigned long count = 0;
+  double t;
+  int i, j;
+
+  for (i=0; i<num_triggers; ++i) {
+    triggers[i] = triggerNew();
+    listeners[i] = listenerSetData(listenerNewWithFunc(count_callback),
+				   &count);
+    triggerListenMany(triggers[i], eventnames, NUM_EVENTNAMES, listeners[i]);
+  }
+  if (scattered) {
+    for (i=num_triggers-1; i>0; --i) {
+      Trigger *const swap = triggers[i];
+      j = rand() % (i + 1);
+      triggers[i] = triggers[j];
+      triggers[j] = swap;
+    }
+  }
+
+  t = seconds();
+  for (j=0; j<num_events; ++j) {
+    for (i=0; i<num_triggers; ++i) {
+      triggerEvent(triggers[i], "dmg ", NULL);
+    }
+  }
+  report(scattered ? "scattered broadcast: triggerEvent() loop"
+	 : "broadcast: triggerEvent() loop", seconds() - t,
+	 (unsigned long)num_events * num_triggers);
+
+  t = seconds();
+  for (j=0; j<num_events; ++j) {
+    triggerEventMulti(triggers, num_triggers, "dmg ", NULL);
+  }
+  report(scattered ? "scattered broadcast: triggerEventMulti()"
+	 : "broadcast: triggerEventMulti()", seconds() - t,
+	 (unsigned long)num_events * num_triggers);
+
+  for (i=0; i<num_triggers; ++i) {
+    listenerDelete(listeners[i]);
+    triggerDelete(triggers[i]);
+  }
+  free(listeners);
+  free(triggers);
+}
+
+
+int
+main(int in_argc, char **in_argv) {
+  bench_spawn_despawn();
+  bench_scheduled_events();
+  bench_graph_load();
+  bench_fan_out();
+  bench_bubbling();
+  bench_broadcast(5000, 400, 0);
+  bench_broadcast(40000, 20, 1);
+
+  return 0;
+}
@@ -13,6 +13,17 @@ my_listener_callback(LFUNC_PARAM)
 }
 
 
+static LFUNC_RTN
+my_payload_callback(LFUNC_PARAM)
+{
+  if (!listenertriggerEventNameIsPrivate(eventname)) {
+    printf("Got event '%c%c%c%c' with payload %d\n",
+	   eventname[0], eventname[1], eventname[2], eventname[3],
+	   *(const int*)eventdata);
+  }
+}
+
+
 int
 main(int in_argc, char **in_argv) {
   Listener *listener  = listenerNew();
@@ -74,6 +85,62 @@ main(int in_argc, char **in_argv) {
   triggerEvent(trigger, "yerf", NULL);
   triggerEvent(trigger, "fuh!", NULL);  
 
+  /* bubbling: events fired on 'weapon' also reach listeners on its
+     parent, 'trigger', and from there on up to trigger2. */
+  {
+    Trigger *weapon = triggerNew();
+
+    triggerSetParent(weapon, trigger);
+    triggerSetParent(trigger, trigger2);
+    if (!triggerSetParent(trigger2, weapon)) {
+      printf("(refused to make a loop)\n");
+    }
+
+    /* 'murr' reaches listener2 and listener3 via 'trigger', then 'yerf'
+       reaches them both via trigger2 */
+    triggerEvent(weapon, "murr", (void*)0xBBBB);
+    triggerEvent(weapon, "yerf", (void*)0xCCCC);
+
+    /* deleting a trigger detaches it from its parent (and deleting a
+       parent would detach its children) */
+    triggerDelete(weapon);
+    triggerSetParent(trigger, NULL);
+  }
+
+  /* scheduled events: 'boom' should reach payload_listener on the third
+     tick, carrying its own copy of 'payload' (so 42, not 0).  The second
+     'boom' is cancelled through its handle, and the 'yerf' scheduled on
+     trigger2 by name, before either can fire. */
+  {
+    TriggerWheel *wheel = triggerWheelNew();
+    Trigger *scratch = triggerNew();
+    Listener *payload_listener = listenerNewWithFunc(my_payload_callback);
+    TriggerTimerHandle timer;
+    int payload = 42;
+
+    triggerListen(trigger, "boom", payload_listener);
+    triggerEventAfter(wheel, trigger, "boom", &payload, sizeof(payload), 3);
+    payload = 0;
+    timer = triggerEventAfter(wheel, trigger, "boom",
+			      &payload, sizeof(payload), 1);
+    triggerCancelTimer(wheel, timer);
+    triggerEventAfter(wheel, trigger2, "yerf", NULL, 0, 2);
+    triggerCancelEvents(trigger2, "yerf");
+
+    triggerTick(wheel);
+    triggerTick(wheel);
+    printf("(third tick)\n");
+    triggerTick(wheel);
+
+    /* left pending; cancelled when 'scratch' is deleted */
+    triggerEventAfter(wheel, scratch, "boom", &payload, sizeof(payload), 1);
+    triggerDelete(scratch);
+    triggerTick(wheel);
+
+    triggerWheelDelete(wheel);
+    listenerDelete(payload_listener);
+  }
+
   triggerDelete(trigger);
   triggerDelete(trigger2);
 
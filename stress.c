@@ -0,0 +1,1462 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "triggers.h"
+
+/* Randomised stress test.  Interleaves listening, unlistening, firing,
+   re-parenting and deletion of triggers and listeners (including
+   auto-delete listeners of both kinds, and deletion by pointer or by
+   handle), scheduling, ticking and cancelling of events on a timing
+   wheel, and callbacks that rearrange things mid-event, and checks every
+   delivery against a simple reference model of who should be listening
+   to what, and checks that graph snapshots load back into something that
+   behaves the same and that broken snapshots are turned away.  Build it
+   with 'make stress' to run it under AddressSanitizer/UBSan as well.
+
+   usage: stress [seed [num_ops]] */
+
+#define NUM_TRIGGERS  24
+#define NUM_LISTENERS 48
+#define NUM_NAMES     8
+#define NUM_TIMERS    64
+
+/* more than triggerEventMulti() works on at once */
+#define NUM_LATE_TRIGGERS 40
+
+static const char *const names[NUM_NAMES] = {
+  "dmg ", "heal", "die ", "move", "fire", "use ", "see ", "tick"
+};
+
+
+/* what a listener's callback has seen.  Each listener has two of these,
+   switched between with listenerSetData(), to check that the change
+   reaches the triggers it is registered with. */
+typedef struct {
+  int listener;
+  unsigned long hits;
+  unsigned long deleted; /* LISTENER_DELETION_EVENT_NAME */
+  unsigned long auto_deleted; /* LISTENER_AUTODELETION_EVENT_NAME */
+  int wrong; /* got something it shouldn't have */
+} Record;
+
+
+/* an event scheduled on the model's wheel; its payload is a copy of its
+   index in model.timer[] */
+typedef struct {
+  int trigger; /* -1 when not pending */
+  int name;
+  unsigned long due;
+  TriggerTimerHandle handle;
+  TriggerTimerHandle old_handle; /* one that has fired or been cancelled */
+} Timer;
+
+
+/* the reference model */
+static struct {
+  Trigger *trigger[NUM_TRIGGERS];
+  int parent[NUM_TRIGGERS]; /* -1 for none */
+  TriggerHandle trigger_handle[NUM_TRIGGERS];
+  TriggerHandle old_trigger_handle[NUM_TRIGGERS]; /* a dead one's, if any */
+
+  Listener *listener[NUM_LISTENERS]; /* NULL when dead */
+  ListenerHandle listener_handle[NUM_LISTENERS];
+  ListenerHandle old_listener_handle[NUM_LISTENERS];
+  int auto_delete[NUM_LISTENERS];
+  int which_record[NUM_LISTENERS];
+  int which_func[NUM_LISTENERS];
+  int stopper[NUM_LISTENERS]; /* calls listenerStopPropagation() */
+  Record record[NUM_LISTENERS][2];
+
+  /* bit n of subs[l][t] set if listener l listens for names[n] on
+     trigger t; linked[l][t] set if l has listened to t at all */
+  unsigned char subs[NUM_LISTENERS][NUM_TRIGGERS];
+  char linked[NUM_LISTENERS][NUM_TRIGGERS];
+
+  /* stops[t] set if the event being worked out stops bubbling at t */
+  char stops[NUM_TRIGGERS];
+
+  /* the event being fired */
+  const char *firing_name;
+  const void *firing_data;
+
+  TriggerWheel *wheel;
+  Timer timer[NUM_TIMERS];
+  int ticking; /* events are being fired by triggerTick() */
+} model;
+
+static TriggerHandles *handles; /* everything in the model is made here */
+static unsigned long seed;
+static unsigned long op;
+static unsigned long num_deliveries;
+
+
+static void
+fail(const char *const what,
+     const int index)
+{
+  fprintf(stderr, "stress: FAILED at seed %lu op %lu: %s (%d)\n",
+	  seed, op, what, index);
+  exit(1);
+}
+
+
+static int
+random_int(const int n)
+{
+  return rand() % n;
+}
+
+
+/* is this a scheduled event falling due right now? */
+static int
+model_timer_due(const char *const eventname,
+		const void *const eventdata)
+{
+  const int k = *(const int*)eventdata;
+
+  return k >= 0 && k < NUM_TIMERS &&
+    model.timer[k].trigger >= 0 &&
+    model.timer[k].due == model.wheel->now &&
+    0 == memcmp(eventname, names[model.timer[k].name], 4);
+}
+
+
+static void
+callback_common(const char *const eventname,
+		const void *const eventdata,
+		Record *const rec,
+		const int func)
+{
+  if (0 == memcmp(eventname, LISTENER_DELETION_EVENT_NAME, 4)) {
+    ++rec->deleted;
+    return;
+  }
+
+  if (0 == memcmp(eventname, LISTENER_AUTODELETION_EVENT_NAME, 4)) {
+    /* we're a free_on_delete == 0 listener, so it's up to us */
+    Listener *const listener = (Listener*)eventdata;
+    ++rec->auto_deleted;
+    if (random_int(2)) {
+      listenerDelete(listener);
+    } else {
+      listenerHandleDelete(handles, listenerGetHandle(listener));
+    }
+    return;
+  }
+
+  if ((model.ticking ? !model_timer_due(eventname, eventdata)
+       : (NULL == model.firing_name ||
+	  0 != memcmp(eventname, model.firing_name, 4) ||
+	  eventdata != model.firing_data)) ||
+      func != model.which_func[rec->listener] ||
+      rec != &model.record[rec->listener][model.which_record[rec->listener]]) {
+    rec->wrong = 1;
+  }
+  ++rec->hits;
+  ++num_deliveries;
+
+  if (model.stopper[rec->listener]) {
+    listenerStopPropagation(model.listener[rec->listener]);
+  }
+}
+
+static LFUNC_RTN
+callback_a(LFUNC_PARAM)
+{
+  callback_common(eventname, eventdata, listener_data, 0);
+}
+
+static LFUNC_RTN
+callback_b(LFUNC_PARAM)
+{
+  callback_common(eventname, eventdata, listener_data, 1);
+}
+
+/* for snapshots; which_func indexes this */
+static LFunction *const functions[2] = { callback_a, callback_b };
+
+
+static void
+clear_records(void)
+{
+  int l, r;
+
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    for (r=0; r<2; ++r) {
+      model.record[l][r].listener = l;
+      model.record[l][r].hits = 0;
+      model.record[l][r].deleted = 0;
+      model.record[l][r].auto_deleted = 0;
+      model.record[l][r].wrong = 0;
+    }
+  }
+}
+
+
+/* check every listener's records against what it should have seen */
+static void
+check_records(const unsigned long *const expected_hits,
+	      const int *const expected_deleted,
+	      const int *const expected_auto_deleted)
+{
+  int l;
+
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    const Record *const a = &model.record[l][0];
+    const Record *const b = &model.record[l][1];
+    if (a->wrong || b->wrong)
+      fail("event delivered to the wrong place", l);
+    if (a->hits + b->hits != (expected_hits ? expected_hits[l] : 0))
+      fail("wrong number of deliveries", l);
+    if (a->deleted + b->deleted != (unsigned long)
+	(expected_deleted ? expected_deleted[l] : 0))
+      fail("wrong number of deletion events", l);
+    if (a->auto_deleted + b->auto_deleted != (unsigned long)
+	(expected_auto_deleted ? expected_auto_deleted[l] : 0))
+      fail("wrong number of auto-deletion events", l);
+  }
+  clear_records();
+}
+
+
+static void
+new_listener(const int l)
+{
+  const ListenerHandle handle = listenerHandleNew(handles);
+  Listener *const listener = listenerHandleGet(handles, handle);
+
+  model.which_record[l] = random_int(2);
+  model.which_func[l] = random_int(2);
+  model.stopper[l] = (0 == random_int(8));
+  listenerSetFunction(listener, model.which_func[l] ? callback_b : callback_a);
+  listenerSetData(listener, &model.record[l][model.which_record[l]]);
+
+  /* mostly ordinary listeners, some of each kind of auto-delete */
+  model.auto_delete[l] = random_int(4);
+  if (model.auto_delete[l] > 2)
+    model.auto_delete[l] = 0;
+  if (model.auto_delete[l]) {
+    listenerAllowAutoDelete(listener, 2 == model.auto_delete[l]);
+  }
+
+  model.listener[l] = listener;
+  model.listener_handle[l] = handle;
+}
+
+
+static void
+new_trigger(const int t)
+{
+  model.trigger_handle[t] = triggerHandleNew(handles);
+  model.trigger[t] = triggerHandleGet(handles, model.trigger_handle[t]);
+  model.parent[t] = -1;
+}
+
+
+/* forget listener l, keeping its handle to check that it has gone stale */
+static void
+model_listener_gone(const int l)
+{
+  int t;
+
+  model.listener[l] = NULL;
+  model.old_listener_handle[l] = model.listener_handle[l];
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    model.subs[l][t] = 0;
+    model.linked[l][t] = 0;
+  }
+}
+
+
+/* forget scheduled event k, keeping its handle to check that it has gone
+   stale */
+static void
+model_timer_gone(const int k)
+{
+  model.timer[k].trigger = -1;
+  model.timer[k].old_handle = model.timer[k].handle;
+}
+
+
+/* a random live listener, or -1 if we couldn't find one quickly */
+static int
+random_listener(void)
+{
+  int tries;
+
+  for (tries=0; tries<8; ++tries) {
+    const int l = random_int(NUM_LISTENERS);
+    if (model.listener[l])
+      return l;
+  }
+  return -1;
+}
+
+
+static void
+model_listen(const int t,
+	     const int n,
+	     const int l)
+{
+  model.subs[l][t] |= 1 << n;
+  model.linked[l][t] = 1;
+}
+
+
+/* work out where names[n] stops bubbling, for model_hits(): at any
+   trigger with a stopper listening for it */
+static void
+model_find_stops(const int n)
+{
+  int t, l;
+
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    model.stops[t] = 0;
+    for (l=0; l<NUM_LISTENERS; ++l) {
+      if (model.listener[l] && model.stopper[l] &&
+	  (model.subs[l][t] & (1 << n)))
+	model.stops[t] = 1;
+    }
+  }
+}
+
+
+/* how many times listener l should hear names[n] fired on trigger t,
+   counting the trip up the parent chain.  model_find_stops(n) must have
+   been called first. */
+static unsigned long
+model_hits(const int t,
+	   const int n,
+	   const int l)
+{
+  unsigned long hits = 0;
+  int level;
+
+  for (level = t; level >= 0; level = model.parent[level]) {
+    if (model.subs[l][level] & (1 << n))
+      ++hits;
+    if (model.stops[level])
+      break;
+  }
+  return hits;
+}
+
+
+static void
+op_fire(void)
+{
+  unsigned long expected[NUM_LISTENERS];
+  int targets[NUM_TRIGGERS];
+  Trigger *triggers[NUM_TRIGGERS];
+  int num_targets = 1;
+  const int n = random_int(NUM_NAMES);
+  int i, l;
+
+  if (random_int(4)) {
+    targets[0] = random_int(NUM_TRIGGERS);
+  } else {
+    /* several at once, possibly with repeats */
+    num_targets = 1 + random_int(NUM_TRIGGERS);
+    for (i=0; i<num_targets; ++i) {
+      targets[i] = random_int(NUM_TRIGGERS);
+    }
+  }
+
+  model_find_stops(n);
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    expected[l] = 0;
+    if (model.listener[l]) {
+      for (i=0; i<num_targets; ++i) {
+	expected[l] += model_hits(targets[i], n, l);
+      }
+    }
+  }
+
+  model.firing_name = names[n];
+  model.firing_data = &expected[random_int(NUM_LISTENERS)];
+  if (1 == num_targets) {
+    triggerEvent(model.trigger[targets[0]], names[n], model.firing_data);
+  } else {
+    for (i=0; i<num_targets; ++i) {
+      triggers[i] = model.trigger[targets[i]];
+    }
+    triggerEventMulti(triggers, num_targets, names[n], model.firing_data);
+  }
+  model.firing_name = NULL;
+
+  check_records(expected, NULL, NULL);
+}
+
+
+static void
+op_listen(void)
+{
+  const int l = random_listener();
+  const int t = random_int(NUM_TRIGGERS);
+  int n;
+
+  if (l < 0)
+    return;
+
+  switch (random_int(3)) {
+  case 0:
+    n = random_int(NUM_NAMES);
+    triggerListen(model.trigger[t], names[n], model.listener[l]);
+    model_listen(t, n, l);
+    break;
+  case 1: {
+    const char *batch[NUM_NAMES];
+    const int count = 1 + random_int(NUM_NAMES);
+    int i;
+    for (i=0; i<count; ++i) {
+      n = random_int(NUM_NAMES);
+      batch[i] = names[n];
+      model_listen(t, n, l);
+    }
+    triggerListenMany(model.trigger[t], batch, count, model.listener[l]);
+    break;
+  }
+  default: {
+    Trigger *batch[NUM_TRIGGERS];
+    const int count = 1 + random_int(NUM_TRIGGERS / 2);
+    int i;
+    n = random_int(NUM_NAMES);
+    for (i=0; i<count; ++i) {
+      const int bt = random_int(NUM_TRIGGERS);
+      batch[i] = model.trigger[bt];
+      model_listen(bt, n, l);
+    }
+    triggerListenMulti(batch, count, names[n], model.listener[l]);
+    break;
+  }
+  }
+}
+
+
+static void
+op_unlisten(void)
+{
+  const int l = random_listener();
+  int t, n;
+
+  if (l < 0)
+    return;
+
+  if (random_int(8)) {
+    t = random_int(NUM_TRIGGERS);
+    n = random_int(NUM_NAMES);
+    if (triggerUnlisten(model.trigger[t], names[n], model.listener[l])
+	!= !!(model.subs[l][t] & (1 << n)))
+      fail("triggerUnlisten() returned the wrong thing", l);
+    model.subs[l][t] &= ~(1 << n);
+  } else {
+    listenerUnlistenAll(model.listener[l]);
+    for (t=0; t<NUM_TRIGGERS; ++t) {
+      model.subs[l][t] = 0;
+      model.linked[l][t] = 0;
+    }
+  }
+}
+
+
+static void
+op_change_listener(void)
+{
+  const int l = random_listener();
+
+  if (l < 0)
+    return;
+
+  switch (random_int(3)) {
+  case 0:
+    model.which_record[l] ^= 1;
+    listenerSetData(model.listener[l],
+		    &model.record[l][model.which_record[l]]);
+    break;
+  case 1:
+    model.which_func[l] ^= 1;
+    listenerSetFunction(model.listener[l],
+			model.which_func[l] ? callback_b : callback_a);
+    break;
+  default:
+    model.stopper[l] ^= 1;
+    break;
+  }
+}
+
+
+static void
+op_set_parent(void)
+{
+  const int t = random_int(NUM_TRIGGERS);
+  const int p = random_int(NUM_TRIGGERS + 1) - 1;
+  int loop = 0;
+  int level;
+
+  for (level = p; level >= 0; level = model.parent[level]) {
+    if (level == t)
+      loop = 1;
+  }
+
+  if (triggerSetParent(model.trigger[t], p < 0 ? NULL : model.trigger[p])
+      == loop)
+    fail("triggerSetParent() returned the wrong thing", t);
+  if (!loop) {
+    model.parent[t] = p;
+  }
+}
+
+
+static void
+op_delete_trigger(void)
+{
+  int expected_deleted[NUM_LISTENERS];
+  int expected_auto_deleted[NUM_LISTENERS];
+  const int t = random_int(NUM_TRIGGERS);
+  int l, i;
+
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    expected_deleted[l] = expected_auto_deleted[l] = 0;
+    if (model.listener[l] && model.linked[l][t]) {
+      int still_linked = 0;
+      model.linked[l][t] = 0;
+      model.subs[l][t] = 0;
+      for (i=0; i<NUM_TRIGGERS; ++i) {
+	still_linked |= model.linked[l][i];
+      }
+      if (!still_linked && model.auto_delete[l]) {
+	/* both kinds end up deleted (the other kind deletes itself
+	   from its callback), but only one is told about it first */
+	expected_deleted[l] = 1;
+	expected_auto_deleted[l] = (1 == model.auto_delete[l]);
+	model_listener_gone(l);
+      }
+    }
+  }
+
+  for (i=0; i<NUM_TRIGGERS; ++i) {
+    if (model.parent[i] == t)
+      model.parent[i] = -1;
+  }
+  /* its scheduled events are cancelled along with it */
+  for (i=0; i<NUM_TIMERS; ++i) {
+    if (model.timer[i].trigger == t)
+      model_timer_gone(i);
+  }
+
+  if (random_int(2)) {
+    triggerDelete(model.trigger[t]);
+  } else {
+    triggerHandleDelete(handles, model.trigger_handle[t]);
+  }
+  check_records(NULL, expected_deleted, expected_auto_deleted);
+
+  /* deleting an auto-deleted listener by its handle is allowed, and must
+     do nothing */
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    if (expected_deleted[l]) {
+      listenerHandleDelete(handles, model.listener_handle[l]);
+    }
+  }
+  check_records(NULL, NULL, NULL);
+
+  model.old_trigger_handle[t] = model.trigger_handle[t];
+  new_trigger(t);
+}
+
+
+static void
+op_delete_listener(void)
+{
+  int expected_deleted[NUM_LISTENERS];
+  const int l = random_listener();
+  int i;
+
+  if (l < 0)
+    return;
+
+  for (i=0; i<NUM_LISTENERS; ++i) {
+    expected_deleted[i] = (i == l);
+  }
+  if (random_int(2)) {
+    listenerDelete(model.listener[l]);
+  } else {
+    listenerHandleDelete(handles, model.listener_handle[l]);
+  }
+  check_records(NULL, expected_deleted, NULL);
+
+  model_listener_gone(l);
+}
+
+
+/* use the handle of something long deleted, which must find nothing and
+   delete nothing, even if the model has since reused its place */
+static void
+op_stale_handle(void)
+{
+  const int t = random_int(NUM_TRIGGERS);
+  const int l = random_int(NUM_LISTENERS);
+
+  if (TRIGGER_NULL_HANDLE != model.old_trigger_handle[t]) {
+    if (triggerHandleGet(handles, model.old_trigger_handle[t]))
+      fail("stale trigger handle still works", t);
+    triggerHandleDelete(handles, model.old_trigger_handle[t]);
+    if (triggerHandleGet(handles, model.trigger_handle[t]) !=
+	model.trigger[t])
+      fail("stale trigger handle deleted something", t);
+  }
+
+  if (TRIGGER_NULL_HANDLE != model.old_listener_handle[l]) {
+    if (listenerHandleGet(handles, model.old_listener_handle[l]))
+      fail("stale listener handle still works", l);
+    listenerHandleDelete(handles, model.old_listener_handle[l]);
+    check_records(NULL, NULL, NULL);
+  }
+}
+
+
+/* save the whole graph, load a copy of it, and check that every event on
+   every trigger reaches the same listeners, as often, in both */
+static void
+op_snapshot(void)
+{
+  Listener *saved[NUM_LISTENERS];
+  void *data[NUM_LISTENERS];
+  Trigger *copy_trigger[NUM_TRIGGERS];
+  Listener *copy_listener[NUM_LISTENERS];
+  unsigned long expected[NUM_LISTENERS];
+  int expected_deleted[NUM_LISTENERS];
+  unsigned char *buffer;
+  size_t size;
+  int num_saved = 0;
+  int saved_triggers, saved_listeners;
+  int t, n, l, copy;
+
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    expected_deleted[l] = 0;
+    if (model.listener[l]) {
+      expected_deleted[l] = 1;
+      data[num_saved] = &model.record[l][model.which_record[l]];
+      saved[num_saved++] = model.listener[l];
+    }
+  }
+
+  size = triggerGraphSave(model.trigger, NUM_TRIGGERS, saved, num_saved,
+			  functions, 2, NULL, 0);
+  buffer = malloc(size);
+  if (triggerGraphSave(model.trigger, NUM_TRIGGERS, saved, num_saved,
+		       functions, 2, buffer, size) != size)
+    fail("triggerGraphSave() changed its mind about the size", (int)size);
+  if (!triggerGraphInfo(buffer, size, &saved_triggers, &saved_listeners) ||
+      NUM_TRIGGERS != saved_triggers || num_saved != saved_listeners)
+    fail("triggerGraphInfo() misread a snapshot", saved_listeners);
+  if (!triggerGraphLoad(buffer, size, functions, 2, data,
+			copy_trigger, copy_listener))
+    fail("triggerGraphLoad() refused a good snapshot", (int)size);
+  free(buffer);
+
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    const Trigger *const parent = triggerGetParent(copy_trigger[t]);
+    if (parent != (model.parent[t] < 0 ? NULL
+		   : copy_trigger[model.parent[t]]))
+      fail("loaded with the wrong parent", t);
+  }
+
+  for (n=0; n<NUM_NAMES; ++n) {
+    model_find_stops(n);
+    for (t=0; t<NUM_TRIGGERS; ++t) {
+      for (l=0; l<NUM_LISTENERS; ++l) {
+	expected[l] = model.listener[l] ? model_hits(t, n, l) : 0;
+      }
+      for (copy=0; copy<2; ++copy) {
+	Trigger *const trigger = copy ? copy_trigger[t] : model.trigger[t];
+	model.firing_name = names[n];
+	model.firing_data = trigger;
+	triggerEvent(trigger, names[n], model.firing_data);
+	model.firing_name = NULL;
+	check_records(expected, NULL, NULL);
+      }
+    }
+  }
+
+  for (l=0; l<num_saved; ++l) {
+    listenerDelete(copy_listener[l]);
+  }
+  check_records(NULL, expected_deleted, NULL);
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    triggerDelete(copy_trigger[t]);
+  }
+}
+
+
+static unsigned char *
+put_u32(unsigned char *const p,
+	const unsigned long value)
+{
+  p[0] = (unsigned char)(value      );
+  p[1] = (unsigned char)(value >>  8);
+  p[2] = (unsigned char)(value >> 16);
+  p[3] = (unsigned char)(value >> 24);
+  return p + 4;
+}
+
+
+/* Writes a snapshot by hand: two triggers, the second the first's child,
+   and one listener (with no callback) on each of the first trigger's
+   'num_slots' slots.  Returns its size. */
+static size_t
+build_snapshot(unsigned char *const buffer,
+	       const char *const *const slot_names,
+	       const int num_slots,
+	       const unsigned long first_parent)
+{
+  unsigned char *p = buffer;
+  int s;
+
+  memcpy(p, "TGrf", 4); p += 4;
+  p = put_u32(p, 1);
+  p = put_u32(p, TRIGGER_TABLE_SIZE);
+  p = put_u32(p, 2);
+  p = put_u32(p, 1);
+
+  p = put_u32(p, 0xFFFFFFFFUL);
+  *p++ = 0;
+
+  p = put_u32(p, first_parent);
+  p = put_u32(p, num_slots);
+  for (s=0; s<num_slots; ++s) {
+    p = put_u32(p, s + 1);
+    memcpy(p, slot_names[s], 4); p += 4;
+    p = put_u32(p, 1);
+    p = put_u32(p, 0);
+  }
+
+  p = put_u32(p, 0);
+  p = put_u32(p, 0);
+
+  return p - buffer;
+}
+
+
+static void
+expect_rejected(const unsigned char *const buffer,
+		const size_t size,
+		const char *const what)
+{
+  Trigger *triggers[2] = { NULL, NULL };
+  Listener *listeners[1] = { NULL };
+
+  if (triggerGraphLoad(buffer, size, functions, 2, NULL,
+		       triggers, listeners) ||
+      triggers[0] || triggers[1] || listeners[0])
+    fail(what, (int)size);
+}
+
+
+/* snapshots that must not load, each a small change to one that must */
+static void
+check_bad_snapshots(void)
+{
+  static const char *const good[2] = { "_TDe", "dmg " };
+  static const char *const same_deletion[2] = { "_TDe", "_TDe" };
+  static const char *const same_name[3] = { "_TDe", "dmg ", "dmg " };
+  unsigned char buffer[256];
+  Trigger *triggers[2];
+  Listener *listeners[1];
+  size_t size, cut;
+
+  size = build_snapshot(buffer, good, 2, 0xFFFFFFFFUL);
+  if (!triggerGraphLoad(buffer, size, functions, 2, NULL,
+			triggers, listeners) ||
+      triggerGetParent(triggers[1]) != triggers[0] ||
+      1 != listeners[0]->num_triggers)
+    fail("hand-made snapshot didn't load properly", (int)size);
+  listenerDelete(listeners[0]);
+  triggerDelete(triggers[1]);
+  triggerDelete(triggers[0]);
+
+  for (cut=0; cut<size; ++cut) {
+    expect_rejected(buffer, cut, "loaded a truncated snapshot");
+  }
+
+  buffer[0] = 'X';
+  expect_rejected(buffer, size, "loaded a snapshot with the wrong magic");
+  buffer[0] = 'T';
+
+  put_u32(buffer + 8, 2 * TRIGGER_TABLE_SIZE);
+  expect_rejected(buffer, size,
+		  "loaded a snapshot with a different table size");
+
+  size = build_snapshot(buffer, same_deletion, 2, 0xFFFFFFFFUL);
+  expect_rejected(buffer, size, "loaded a snapshot with two deletion lists");
+  size = build_snapshot(buffer, same_name, 3, 0xFFFFFFFFUL);
+  expect_rejected(buffer, size, "loaded a snapshot with a repeated name");
+
+  size = build_snapshot(buffer, good, 2, 1);
+  expect_rejected(buffer, size, "loaded a snapshot with a parent loop");
+  size = build_snapshot(buffer, good, 2, 0);
+  expect_rejected(buffer, size, "loaded a snapshot with its own parent");
+}
+
+
+/* for check_multi_subscribe() */
+static Trigger *late_triggers[NUM_LATE_TRIGGERS];
+static Listener *late_listener;
+static int late_hits;
+
+static LFUNC_RTN
+callback_subscribe_late(LFUNC_PARAM)
+{
+  if (0 == memcmp(eventname, "dmg ", 4)) {
+    /* not the first one, which op_meddle() covers */
+    triggerListenMulti(late_triggers + 1, NUM_LATE_TRIGGERS - 1, "dmg ",
+		       late_listener);
+  }
+}
+
+static LFUNC_RTN
+callback_count_late(LFUNC_PARAM)
+{
+  if (0 == memcmp(eventname, "dmg ", 4)) {
+    ++late_hits;
+  }
+}
+
+
+/* triggerEventMulti() has to reach listeners that a delivery earlier in
+   the same call subscribed to the triggers after it, just as a run of
+   triggerEvent()s would */
+static void
+check_multi_subscribe(void)
+{
+  Listener *const first = listenerNew();
+  int t;
+
+  late_listener = listenerNew();
+  listenerSetFunction(first, callback_subscribe_late);
+  listenerSetFunction(late_listener, callback_count_late);
+  for (t=0; t<NUM_LATE_TRIGGERS; ++t) {
+    late_triggers[t] = triggerNew();
+  }
+  triggerListen(late_triggers[0], "dmg ", first);
+
+  late_hits = 0;
+  triggerEventMulti(late_triggers, NUM_LATE_TRIGGERS, "dmg ", NULL);
+  if (NUM_LATE_TRIGGERS - 1 != late_hits)
+    fail("triggerEventMulti() missed a listener added part way", late_hits);
+
+  listenerDelete(first);
+  listenerDelete(late_listener);
+  for (t=0; t<NUM_LATE_TRIGGERS; ++t) {
+    triggerDelete(late_triggers[t]);
+  }
+}
+
+
+/* a random number of ticks below 'n', which may be more than rand()
+   can manage on its own */
+static unsigned long
+random_ticks(const unsigned long n)
+{
+  return (((unsigned long)rand() << 16) ^ (unsigned long)rand()) % n;
+}
+
+
+/* for check_wheel_timing(): what became of each scheduled event */
+#define TIMING_EVENTS   400000
+#define TIMING_END      ((1UL << (4 * TRIGGER_WHEEL_BITS)) + 4096)
+#define TIMING_TRIGGERS 4
+
+enum { TIMING_PENDING, TIMING_FIRED, TIMING_CANCELLED };
+
+static struct {
+  TriggerWheel *wheel;
+  Trigger *trigger[TIMING_TRIGGERS];
+  Listener *listener;
+  unsigned long num_events;
+  unsigned long id[TIMING_EVENTS]; /* id[i] == i, as a verbatim payload */
+  unsigned long due[TIMING_EVENTS];
+  TriggerTimerHandle handle[TIMING_EVENTS];
+  char which[TIMING_EVENTS]; /* index into trigger[] */
+  char state[TIMING_EVENTS];
+} timing;
+
+
+/* from inside a scheduled event on trigger 'busy', delete one of the
+   other triggers with events still pending on it and put a fresh one in
+   its place */
+static void
+timing_replace_trigger(const int busy)
+{
+  const int t = (busy + 1 + random_int(TIMING_TRIGGERS - 1)) %
+    TIMING_TRIGGERS;
+  unsigned long i;
+
+  for (i=0; i<timing.num_events; ++i) {
+    if (t == timing.which[i] && TIMING_PENDING == timing.state[i])
+      timing.state[i] = TIMING_CANCELLED;
+  }
+  triggerDelete(timing.trigger[t]);
+  timing.trigger[t] = triggerNew();
+  triggerListen(timing.trigger[t], "tick", timing.listener);
+}
+
+static LFUNC_RTN
+callback_timing(LFUNC_PARAM)
+{
+  unsigned long i;
+
+  if (listenertriggerEventNameIsPrivate(eventname))
+    return;
+
+  i = *(const unsigned long*)eventdata;
+  if (TIMING_PENDING != timing.state[i])
+    fail("scheduled event fired twice or after being cancelled", (int)i);
+  if (timing.wheel->now != timing.due[i])
+    fail("scheduled event fired at the wrong time", (int)i);
+  if (triggerCancelTimer(timing.wheel, timing.handle[i]))
+    fail("cancelled a scheduled event while it was firing", (int)i);
+  timing.state[i] = TIMING_FIRED;
+  (void)listener_data;
+
+  /* now and then cancel some other event -- often its neighbour, which
+     may well be due this very tick -- or throw away another trigger along
+     with its events */
+  if (0 == random_int(64)) {
+    const unsigned long j = random_int(2) ? random_ticks(timing.num_events)
+      : (i ^ 1) < timing.num_events ? (i ^ 1) : i;
+    if (triggerCancelTimer(timing.wheel, timing.handle[j])
+	!= (TIMING_PENDING == timing.state[j]))
+      fail("triggerCancelTimer() returned the wrong thing mid-tick", (int)j);
+    if (TIMING_PENDING == timing.state[j])
+      timing.state[j] = TIMING_CANCELLED;
+  }
+  if (0 == random_int(8192))
+    timing_replace_trigger(timing.which[i]);
+}
+
+
+/* schedule lots of events with delays of all sizes, including past the
+   wheel's horizon, from all sorts of starting times, and check that each
+   fires on exactly the right tick -- or not at all if it's cancelled
+   through its handle first, or its trigger is deleted, which the events
+   themselves sometimes do to each other */
+static void
+check_wheel_timing(void)
+{
+  static const unsigned long max_delay[5] = {
+    64, 4096, 1UL << 18, 1UL << 24, 1UL << 26
+  };
+  unsigned long i, expected_fired = 0, fired = 0;
+  int t;
+
+  timing.wheel = triggerWheelNew();
+  timing.listener = listenerNewWithFunc(callback_timing);
+  timing.num_events = 0;
+  for (t=0; t<TIMING_TRIGGERS; ++t) {
+    timing.trigger[t] = triggerNew();
+    triggerListen(timing.trigger[t], "tick", timing.listener);
+  }
+
+  while (timing.wheel->now < TIMING_END) {
+    /* a few new events every so often, and a cancellation */
+    if (0 == (timing.wheel->now & 255) &&
+	timing.num_events < TIMING_EVENTS - 8) {
+      const int batch = random_int(8);
+      unsigned long ticks = 0;
+      int b;
+      for (b=0; b<batch; ++b) {
+	Trigger *trigger;
+	/* pairs of events often fall due together */
+	if (0 == (timing.num_events & 1) || random_int(2))
+	  ticks = random_ticks(max_delay[random_int(5)]);
+	i = timing.num_events++;
+	timing.id[i] = i;
+	timing.due[i] = timing.wheel->now + (ticks ? ticks : 1);
+	timing.which[i] = (char)random_int(TIMING_TRIGGERS);
+	timing.state[i] = TIMING_PENDING;
+	trigger = timing.trigger[(int)timing.which[i]];
+	if (random_int(2)) {
+	  timing.handle[i] = triggerEventAfter(timing.wheel, trigger, "tick",
+					       &i, sizeof(i), ticks);
+	} else {
+	  timing.handle[i] = triggerEventAfter(timing.wheel, trigger, "tick",
+					       &timing.id[i], 0, ticks);
+	}
+      }
+      if (timing.num_events) {
+	i = random_ticks(timing.num_events);
+	if (triggerCancelTimer(timing.wheel, timing.handle[i])
+	    != (TIMING_PENDING == timing.state[i]))
+	  fail("triggerCancelTimer() returned the wrong thing", (int)i);
+	if (TIMING_PENDING == timing.state[i])
+	  timing.state[i] = TIMING_CANCELLED;
+      }
+    }
+    triggerTick(timing.wheel);
+  }
+
+  for (i=0; i<timing.num_events; ++i) {
+    if (TIMING_CANCELLED != timing.state[i] && timing.due[i] <= TIMING_END)
+      ++expected_fired;
+    if (TIMING_FIRED == timing.state[i])
+      ++fired;
+  }
+  if (fired != expected_fired)
+    fail("scheduled events went missing", (int)(expected_fired - fired));
+
+  triggerWheelDelete(timing.wheel);
+  listenerDelete(timing.listener);
+  for (t=0; t<TIMING_TRIGGERS; ++t) {
+    triggerDelete(timing.trigger[t]);
+  }
+}
+
+
+/* for check_embedded_auto_delete() */
+typedef struct {
+  int deleted;
+  Listener listener;
+} Embedded;
+
+static LFUNC_RTN
+callback_embedded(LFUNC_PARAM)
+{
+  if (0 == memcmp(eventname, LISTENER_DELETION_EVENT_NAME, 4)) {
+    ++((Embedded*)listener_data)->deleted;
+  }
+}
+
+
+/* a free_on_delete listener living inside something else must be tidied
+   up, but not freed, when its last trigger goes */
+static void
+check_embedded_auto_delete(void)
+{
+  Embedded embedded[2];
+  Trigger *const trigger = triggerNew();
+  int i;
+
+  for (i=0; i<2; ++i) {
+    embedded[i].deleted = 0;
+    listenerInit(&embedded[i].listener);
+    listenerSetFunction(&embedded[i].listener, callback_embedded);
+    listenerSetData(&embedded[i].listener, &embedded[i]);
+    listenerAllowAutoDelete(&embedded[i].listener, 1);
+    triggerListen(trigger, "dmg ", &embedded[i].listener);
+  }
+  triggerDelete(trigger);
+
+  for (i=0; i<2; ++i) {
+    if (1 != embedded[i].deleted || embedded[i].listener.num_triggers)
+      fail("embedded auto-delete listener not tidied up", i);
+  }
+}
+
+
+/* for op_meddle(): listeners whose callbacks change the very slot that
+   is being fired, on a short parent chain of their own */
+#define MEDDLE_LEVELS    3
+#define MEDDLE_LISTENERS 12
+
+enum {
+  MEDDLE_PLAIN,
+  MEDDLE_UNLISTEN, /* stops listening to everything */
+  MEDDLE_SUBSCRIBE, /* subscribes the late listener everywhere */
+  MEDDLE_DELETE, /* deletes its own listener */
+  MEDDLE_STOP, /* stops the event bubbling any further */
+  MEDDLE_DELETE_STOP, /* both of those */
+  NUM_MEDDLE_ROLES
+};
+
+typedef struct {
+  Listener *listener;
+  int role;
+  int levels; /* bit n set if listening on level n */
+  unsigned long hits;
+} Meddler;
+
+static struct {
+  Trigger *level[MEDDLE_LEVELS]; /* each the parent of the one before */
+  int num_levels;
+  Meddler meddler[MEDDLE_LISTENERS];
+  Meddler late;
+} meddle;
+
+static LFUNC_RTN
+callback_meddle(LFUNC_PARAM)
+{
+  Meddler *const m = listener_data;
+
+  if (listenertriggerEventNameIsPrivate(eventname))
+    return;
+
+  ++m->hits;
+  switch (m->role) {
+  case MEDDLE_UNLISTEN:
+    listenerUnlistenAll(m->listener);
+    break;
+  case MEDDLE_SUBSCRIBE:
+    triggerListenMulti(meddle.level, meddle.num_levels, "dmg ",
+		       meddle.late.listener);
+    break;
+  case MEDDLE_DELETE:
+    listenerDelete(m->listener);
+    m->listener = NULL;
+    break;
+  case MEDDLE_STOP:
+    listenerStopPropagation(m->listener);
+    break;
+  case MEDDLE_DELETE_STOP:
+    listenerStopPropagation(m->listener);
+    listenerDelete(m->listener);
+    m->listener = NULL;
+    break;
+  }
+}
+
+
+static int
+count_bits(int bits)
+{
+  int n = 0;
+
+  for (; bits; bits >>= 1) {
+    n += bits & 1;
+  }
+  return n;
+}
+
+
+/* fire an event whose listeners, while it's being delivered, unsubscribe
+   or delete themselves (which frees the listener list when they're the
+   last), subscribe others to it (which moves the list) or stop it
+   bubbling */
+static void
+op_meddle(void)
+{
+  const int num_meddlers = 1 + random_int(MEDDLE_LISTENERS);
+  int first_subscribe = MEDDLE_LEVELS; /* lowest level with a subscriber */
+  int top; /* the highest level the event reaches */
+  int i, level;
+
+  meddle.num_levels = 1 + random_int(MEDDLE_LEVELS);
+  for (level=0; level<meddle.num_levels; ++level) {
+    meddle.level[level] = triggerNew();
+    if (level > 0)
+      triggerSetParent(meddle.level[level - 1], meddle.level[level]);
+  }
+
+  meddle.late.listener = listenerNewWithFunc(callback_meddle);
+  listenerSetData(meddle.late.listener, &meddle.late);
+  meddle.late.role = MEDDLE_PLAIN;
+  meddle.late.hits = 0;
+
+  for (i=0; i<num_meddlers; ++i) {
+    Meddler *const m = &meddle.meddler[i];
+    m->listener = listenerNewWithFunc(callback_meddle);
+    listenerSetData(m->listener, m);
+    m->role = random_int(NUM_MEDDLE_ROLES);
+    m->levels = 1 + random_int((1 << meddle.num_levels) - 1);
+    m->hits = 0;
+    for (level=0; level<meddle.num_levels; ++level) {
+      if (m->levels & (1 << level)) {
+	triggerListen(meddle.level[level], "dmg ", m->listener);
+	if (MEDDLE_SUBSCRIBE == m->role && level < first_subscribe)
+	  first_subscribe = level;
+      }
+    }
+  }
+
+  top = meddle.num_levels - 1;
+  for (i=0; i<num_meddlers; ++i) {
+    const Meddler *const m = &meddle.meddler[i];
+    if (MEDDLE_STOP == m->role || MEDDLE_DELETE_STOP == m->role) {
+      for (level=0; level<top; ++level) {
+	if (m->levels & (1 << level))
+	  top = level;
+      }
+    }
+  }
+
+  if (random_int(2)) {
+    triggerEvent(meddle.level[0], "dmg ", NULL);
+  } else {
+    triggerEventMulti(meddle.level, 1, "dmg ", NULL);
+  }
+
+  for (i=0; i<num_meddlers; ++i) {
+    const Meddler *const m = &meddle.meddler[i];
+    const int n = count_bits(m->levels & ((2 << top) - 1));
+    const int once = MEDDLE_UNLISTEN == m->role ||
+      MEDDLE_DELETE == m->role || MEDDLE_DELETE_STOP == m->role;
+    if (m->hits != (unsigned long)(once && n > 1 ? 1 : n))
+      fail("meddling listener heard the wrong number of events", i);
+  }
+
+  /* the late listener hears the event on every level the event reaches
+     after the first one it was subscribed on, and on that one too if it
+     landed after the subscriber in the list */
+  if (first_subscribe <= top) {
+    if (meddle.late.hits < (unsigned long)(top - first_subscribe) ||
+	meddle.late.hits > (unsigned long)(top - first_subscribe + 1))
+      fail("late listener heard the wrong number of events",
+	   (int)meddle.late.hits);
+  } else if (meddle.late.hits) {
+    fail("late listener heard an event it wasn't subscribed for",
+	 (int)meddle.late.hits);
+  }
+
+  for (i=0; i<num_meddlers; ++i) {
+    if (meddle.meddler[i].listener)
+      listenerDelete(meddle.meddler[i].listener);
+  }
+  listenerDelete(meddle.late.listener);
+  for (level=0; level<meddle.num_levels; ++level) {
+    triggerDelete(meddle.level[level]);
+  }
+}
+
+
+/* schedule an event on a random trigger, usually soon but now and then
+   beyond the wheel's horizon, where it can only ever be cancelled */
+static void
+op_schedule(void)
+{
+  unsigned long ticks;
+  int k;
+
+  for (k=0; k<NUM_TIMERS && model.timer[k].trigger >= 0; ++k)
+    ;
+  if (NUM_TIMERS == k)
+    return;
+
+  ticks = random_int(16) ? (unsigned long)random_int(40)
+    : random_ticks(1UL << 26);
+  model.timer[k].trigger = random_int(NUM_TRIGGERS);
+  model.timer[k].name = random_int(NUM_NAMES);
+  model.timer[k].due = model.wheel->now + (ticks ? ticks : 1);
+  model.timer[k].handle =
+    triggerEventAfter(model.wheel, model.trigger[model.timer[k].trigger],
+		      names[model.timer[k].name], &k, sizeof(k), ticks);
+}
+
+
+/* advance the wheel a few ticks, checking that exactly the events due on
+   each one are delivered */
+static void
+op_tick(void)
+{
+  unsigned long expected[NUM_LISTENERS];
+  int ticks = 1 + random_int(8);
+  int k, l;
+
+  while (ticks--) {
+    const unsigned long now = model.wheel->now + 1;
+
+    for (l=0; l<NUM_LISTENERS; ++l) {
+      expected[l] = 0;
+    }
+    for (k=0; k<NUM_TIMERS; ++k) {
+      if (model.timer[k].trigger >= 0 && model.timer[k].due == now) {
+	model_find_stops(model.timer[k].name);
+	for (l=0; l<NUM_LISTENERS; ++l) {
+	  if (model.listener[l])
+	    expected[l] += model_hits(model.timer[k].trigger,
+				      model.timer[k].name, l);
+	}
+      }
+    }
+
+    model.ticking = 1;
+    triggerTick(model.wheel);
+    model.ticking = 0;
+    check_records(expected, NULL, NULL);
+
+    for (k=0; k<NUM_TIMERS; ++k) {
+      if (model.timer[k].trigger >= 0 && model.timer[k].due == now)
+	model_timer_gone(k);
+    }
+  }
+}
+
+
+/* cancel one scheduled event through its handle (which may be stale), or
+   some of a trigger's by name */
+static void
+op_cancel(void)
+{
+  int k = random_int(NUM_TIMERS);
+  int t, n, expected = 0;
+
+  if (random_int(2)) {
+    if (model.timer[k].trigger >= 0) {
+      if (1 != triggerCancelTimer(model.wheel, model.timer[k].handle))
+	fail("couldn't cancel a pending event", k);
+      model_timer_gone(k);
+    } else if (0 != triggerCancelTimer(model.wheel,
+				       model.timer[k].old_handle)) {
+      fail("cancelled an event through a stale handle", k);
+    }
+    return;
+  }
+
+  t = random_int(NUM_TRIGGERS);
+  n = random_int(NUM_NAMES + 1) - 1; /* -1 for all of them */
+  for (k=0; k<NUM_TIMERS; ++k) {
+    if (model.timer[k].trigger == t && (n < 0 || model.timer[k].name == n)) {
+      ++expected;
+      model_timer_gone(k);
+    }
+  }
+  if (triggerCancelEvents(model.trigger[t], n < 0 ? NULL : names[n])
+      != expected)
+    fail("triggerCancelEvents() cancelled the wrong number of events",
+	 expected);
+}
+
+
+/* compare the library's own bookkeeping with the model */
+static void
+check_structure(void)
+{
+  int num_live = 0;
+  int t, l, i;
+
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    const Trigger *const parent = triggerGetParent(model.trigger[t]);
+    if (parent != (model.parent[t] < 0 ? NULL
+		   : model.trigger[model.parent[t]]))
+      fail("wrong parent", t);
+    if (triggerHandleGet(handles, model.trigger_handle[t]) !=
+	model.trigger[t] ||
+	triggerGetHandle(model.trigger[t]) != model.trigger_handle[t])
+      fail("trigger and handle don't match", t);
+  }
+
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    int num_linked = 0;
+    if (!model.listener[l])
+      continue;
+    ++num_live;
+    for (t=0; t<NUM_TRIGGERS; ++t) {
+      num_linked += model.linked[l][t];
+    }
+    if (model.listener[l]->num_triggers != num_linked)
+      fail("listener watching the wrong number of triggers", l);
+    if (listenerHandleGet(handles, model.listener_handle[l]) !=
+	model.listener[l] ||
+	listenerGetHandle(model.listener[l]) != model.listener_handle[l])
+      fail("listener and handle don't match", l);
+  }
+
+  /* the dense arrays hold exactly what's alive */
+  if (triggerHandlesNumTriggers(handles) != NUM_TRIGGERS)
+    fail("wrong number of triggers with handles",
+	 triggerHandlesNumTriggers(handles));
+  if (listenerHandlesNumListeners(handles) != num_live)
+    fail("wrong number of listeners with handles",
+	 listenerHandlesNumListeners(handles));
+  for (i=0; i<NUM_TRIGGERS; ++i) {
+    Trigger *const trigger = triggerHandlesTrigger(handles, i);
+    if (triggerHandleGet(handles, triggerGetHandle(trigger)) != trigger)
+      fail("dense trigger array out of step", i);
+  }
+  for (i=0; i<num_live; ++i) {
+    Listener *const listener = listenerHandlesListener(handles, i);
+    if (listenerHandleGet(handles, listenerGetHandle(listener)) != listener)
+      fail("dense listener array out of step", i);
+  }
+}
+
+
+int
+main(int in_argc, char **in_argv) {
+  unsigned long num_ops = 1000000;
+  clock_t start;
+  double elapsed;
+  int t, l, k;
+
+  seed = in_argc > 1 ? strtoul(in_argv[1], NULL, 0) : 1;
+  if (in_argc > 2)
+    num_ops = strtoul(in_argv[2], NULL, 0);
+  srand((unsigned int)seed);
+
+  check_bad_snapshots();
+  check_multi_subscribe();
+  check_embedded_auto_delete();
+  check_wheel_timing();
+
+  clear_records();
+  handles = triggerHandlesNew();
+  model.wheel = triggerWheelNew();
+  for (k=0; k<NUM_TIMERS; ++k) {
+    model.timer[k].trigger = -1;
+    model.timer[k].old_handle = TRIGGER_NULL_HANDLE;
+  }
+  for (t=0; t<NUM_TRIGGERS; ++t) {
+    new_trigger(t);
+    model.old_trigger_handle[t] = TRIGGER_NULL_HANDLE;
+  }
+  for (l=0; l<NUM_LISTENERS; ++l) {
+    new_listener(l);
+    model.old_listener_handle[l] = TRIGGER_NULL_HANDLE;
+  }
+
+  start = clock();
+  for (op=0; op<num_ops; ++op) {
+    const int r = random_int(100);
+    if (r < 28)
+      op_fire();
+    else if (r < 55)
+      op_listen();
+    else if (r < 69)
+      op_unlisten();
+    else if (r < 74)
+      op_change_listener();
+    else if (r < 78)
+      op_set_parent();
+    else if (r < 82)
+      op_delete_trigger();
+    else if (r < 85)
+      op_delete_listener();
+    else if (r < 86)
+      op_stale_handle();
+    else if (r < 87)
+      op_meddle();
+    else if (r < 88) {
+      /* these are slow, so only now and then */
+      if (0 == random_int(10))
+	op_snapshot();
+    } else if (r < 91)
+      op_schedule();
+    else if (r < 93)
+      op_tick();
+    else if (r < 94)
+      op_cancel();
+    else {
+      l = random_int(NUM_LISTENERS);
+      if (!model.listener[l])
+	new_listener(l);
+    }
+
+    if (0 == op % 1024)
+      check_structure();
+  }
+  elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  check_structure();
+
+  /* with events still pending on live triggers */
+  triggerWheelDelete(model.wheel);
+  triggerHandlesDelete(handles);
+
+  printf("stress: seed %lu, %lu ops OK in %.2f s "
+	 "(%.0f ops/s, %.0f deliveries/s)\n",
+	 seed, num_ops, elapsed,
+	 elapsed > 0 ? num_ops / elapsed : 0.0,
+	 elapsed > 0 ? num_deliveries / elapsed : 0.0);
+
+  return 0;
+}
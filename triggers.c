@@ -15,7 +15,32 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
 /*
-  AdamTriggers v0.85.2 - 2004-07-30
+  AdamTriggers v0.86.0 - unreleased
+
+  v0.86.0
+  - triggerListenMany(), triggerListenMulti() and listenerUnlistenAll()
+    bulk subscription functions added
+  - triggerEventAfter() and triggerTick() schedule events to fire after
+    a number of ticks, using a hierarchical timing wheel;
+    triggerCancelTimer() cancels one through the handle
+    triggerEventAfter() returns
+  - triggerSetParent() links triggers into chains along which events
+    bubble; listenerStopPropagation() stops an event bubbling further
+  - triggers cache recent event slot lookups, so that events which
+    nobody on a trigger is listening for (as when bubbling through
+    uninterested triggers) no longer cost a search of the whole table
+  - triggerGraphSave()/triggerGraphLoad() snapshot and rebuild the
+    subscription graph in bulk
+  - generation-checked TriggerHandle/ListenerHandle API added
+  - auto-delete listeners with free_on_delete set really are freed now,
+    if they were made by listenerNew() or listenerHandleNew().  They used
+    to leak, so code that called listenerDelete() on one after it had
+    been auto-deleted got away with it; that is now a use-after-free, and
+    such calls must be removed.  Listeners set up in place with
+    listenerInit() are only tidied up, as before.
+  - trigger listener lists hold copies of each listener's callback and
+    data, so event delivery doesn't touch the listeners themselves
+  - triggerEventMulti() fires one event on many triggers
 
   2004-07-30: v0.85.2
   - listenertriggerEventNameIsPrivate() function added
@@ -57,12 +82,39 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdio.h>
 #endif
 
+/* a hint that we'll soon want the memory at 'addr'; only does something
+   on compilers known to support it. */
+#ifdef __GNUC__
+#define TRIGGER_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define TRIGGER_PREFETCH(addr) ((void)0)
+#endif
+
+/* how many triggers triggerEventMulti() looks up at a time before
+   delivering the event to them */
+#define TRIGGER_MULTI_BATCH 16
+
+/* the parts of a TriggerHandle, TriggerTimerHandle etc. */
+#define HANDLE_INDEX_MASK ((1UL << TRIGGER_HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK (0xFFFFFFFFUL >> TRIGGER_HANDLE_INDEX_BITS)
+
 
 static void
 listener_disregard_trigger(Listener *const listener,
 			   const Trigger *const trigger);
 static void
 listener_really_delete_inner(Listener *const listener);
+static void
+handle_table_release(TriggerHandleTable *const table,
+		     const unsigned long handle);
+static int
+find_name_slot(const Trigger *const trigger,
+	       const char *const eventname,
+	       int *const index);
+static void
+send_event_to_listener(Listener *const listener,
+		       const char *const eventname,
+		       const void *const eventdata);
 
 /****************************************************/
 
@@ -102,12 +154,40 @@ eventname_equals(const char *const str1,
 }
 
 
+/* callback for a trigger's parent_link listener, which is an auto-delete
+   listener watching only its parent; it auto-deletes when the parent
+   does. */
+static LFUNC_RTN
+trigger_parent_deleted(LFUNC_PARAM)
+{
+  if (eventname_equals(eventname, LISTENER_AUTODELETION_EVENT_NAME)) {
+    ((Trigger*)listener_data)->parent = NULL;
+  }
+}
+
+
+/* forget the trigger's cached event lookups; needed whenever an event
+   slot is created or vacated. */
+static void
+trigger_forget_lookups(Trigger *const trigger)
+{
+  int i;
+
+  for (i=0; i<TRIGGER_LOOKUP_CACHE_SIZE; ++i) {
+    memset(trigger->lookup[i].name, 0, 4);
+    trigger->lookup[i].index = -1;
+  }
+}
+
+
 Trigger*
 triggerNew(void)
 {
   int i;
   Trigger *rtn = malloc(sizeof(Trigger));
 
+  trigger_forget_lookups(rtn);
+
   for (i=0; i<TRIGGER_TABLE_SIZE; ++i) {
     rtn->event[i].name[0] =
       rtn->event[i].name[1] = '\0';
@@ -115,6 +195,15 @@ triggerNew(void)
     rtn->event[i].allocated_listeners = 0;
     rtn->event[i].listeners = NULL;
   }
+  rtn->timers = NULL;
+  rtn->handle_table = NULL;
+  rtn->handle = TRIGGER_NULL_HANDLE;
+
+  rtn->parent = NULL;
+  listenerInit(&rtn->parent_link);
+  listenerSetFunction(&rtn->parent_link, trigger_parent_deleted);
+  listenerSetData(&rtn->parent_link, rtn);
+  listenerAllowAutoDelete(&rtn->parent_link, 0);
 
   return rtn;
 }
@@ -132,6 +221,10 @@ trigger_free(Trigger *const trigger)
     }
   }
 
+  if (trigger->handle_table) {
+    handle_table_release(trigger->handle_table, trigger->handle);
+  }
+
 #ifdef TRIGGER_DEBUG
   fprintf(stderr, "(FREEING TRIGGER %p) ", trigger);
 #endif
@@ -142,10 +235,31 @@ trigger_free(Trigger *const trigger)
 void 
 triggerDelete(Trigger *const trigger)
 {
+  int index;
+
+  /* scheduled events for a dead trigger would have nowhere to go */
+  triggerCancelEvents(trigger, NULL);
+
+  /* detach from our parent */
+  listenerUnlistenAll(&trigger->parent_link);
+
   /* tell all listeners that this trigger is being deleted, so they
-     can remove their own mutual notification link.
+     can remove their own mutual notification link.  (This includes our
+     children's parent_links.)  This is done here rather than as a
+     normal event so that event delivery needn't check for it.
   */
-  triggerEvent(trigger, TRIGGER_DELETION_EVENT_NAME, trigger);
+  if (find_name_slot(trigger, TRIGGER_DELETION_EVENT_NAME, &index)) {
+    int i;
+    for (i=0; i<trigger->event[index].allocated_listeners; ++i) {
+      Listener *const listener = trigger->event[index].listeners[i].listener;
+      if (NULL != listener) {
+#ifdef TRIGGER_DEBUG
+	fprintf(stderr, "{TRIGGER %p DELETED -> L%p}\n", trigger, listener);
+#endif
+	listener_disregard_trigger(listener, trigger);
+      }
+    }
+  }
 
   /* physically delete the trigger structure and data */
   trigger_free(trigger);
@@ -169,14 +283,13 @@ name32_to_hash_key8(const char *const name)
    all, or to -1 if the event name was not found and the table is full.
  */
 static int
-find_name_slot(const Trigger *const trigger,
-	       const char *const eventname,
-	       int *const index)
+find_name_slot_keyed(const Trigger *const trigger,
+		     const char *const eventname,
+		     const unsigned char key,
+		     int *const index)
 {
   int i;
   int vacant_index = -1; /* if table is full, this -1 will persist */
-  const unsigned char key =
-    name32_to_hash_key8(eventname) % TRIGGER_TABLE_SIZE;
 
   for (i=key; i<key+TRIGGER_TABLE_SIZE; ++i) {
     if (eventname_equals(trigger->event[i%TRIGGER_TABLE_SIZE].name,
@@ -201,6 +314,48 @@ find_name_slot(const Trigger *const trigger,
   return 0; /* eventname not in table */
 }
 
+/* returns the index of the event name's slot for event delivery, or -1 if
+   no-one is listening for it.  Remembers the answer either way, since a
+   miss would otherwise mean searching the whole table every time. */
+static int
+find_event_slot(Trigger *const trigger,
+		const char *const eventname,
+		const unsigned char key)
+{
+  int index;
+  const int c = key & (TRIGGER_LOOKUP_CACHE_SIZE - 1);
+
+  /* the usual case -- found in its home slot -- needs no help */
+  if (eventname_equals(trigger->event[key].name, eventname)) {
+    return key;
+  }
+
+  if (eventname_equals(trigger->lookup[c].name, eventname)) {
+    return trigger->lookup[c].index;
+  }
+
+  if (0 == find_name_slot_keyed(trigger, eventname, key, &index)) {
+    index = -1;
+  }
+  memcpy(trigger->lookup[c].name, eventname, 4);
+  trigger->lookup[c].index = (short int)index;
+
+  return index;
+}
+
+/* as find_name_slot_keyed(), for when the caller hasn't already hashed
+   the event name. */
+static int
+find_name_slot(const Trigger *const trigger,
+	       const char *const eventname,
+	       int *const index)
+{
+  return find_name_slot_keyed(trigger, eventname,
+			      name32_to_hash_key8(eventname)
+			      % TRIGGER_TABLE_SIZE,
+			      index);
+}
+
 static void
 send_event_to_listener(Listener *const listener,
 		       const char *const eventname,
@@ -212,25 +367,88 @@ send_event_to_listener(Listener *const listener,
 	  listener, eventdata);
 #endif
 
-  /* non-negotiable! */
-  if (eventname_equals(TRIGGER_DELETION_EVENT_NAME, eventname)) {
-    listener_disregard_trigger(listener, eventdata);
-    return;
-  }
-
   if (NULL != listener->receptor_func) {
     listener->receptor_func(eventname, eventdata, listener->data);
   }
 }
 
 
+/* the stop flag of the innermost event delivery in progress, which
+   listenerStopPropagation() sets; NULL when no event is being delivered.
+   It lives outside the Listener since a callback may delete its own
+   Listener. */
+static int* dispatch_stop = NULL;
+
+
+/* deliver an event to the listeners in the given event slot.  Returns 1
+   if any of them asked for propagation to stop, else 0. */
+static int
+trigger_dispatch(Trigger *const trigger,
+		 const int index,
+		 const char *const eventname,
+		 const void *const eventdata)
+{
+  int i;
+  int stop = 0;
+  int *const outer_stop = dispatch_stop;
+
+  /* iterate through our possibly-sparse listener list for this event
+     type, sending the event to each listener.  Vacant entries (and
+     deletion-list entries) have a NULL func.  A callback may add or
+     remove listeners for this very event, which can move or free the
+     list, so the list and its length are looked up afresh each time
+     round rather than held across the calls. */
+  dispatch_stop = &stop;
+  for (i=0; i<trigger->event[index].allocated_listeners; ++i) {
+    const TriggerSubscriber *const subscriber =
+      &trigger->event[index].listeners[i];
+    if (NULL != subscriber->func) {
+#ifdef TRIGGER_DEBUG
+      fprintf(stderr, "{EV:\"%c%c%c%c\" -> L%p:D%p}\n",
+	      eventname[0], eventname[1], eventname[2], eventname[3],
+	      subscriber->listener, eventdata);
+#endif
+      subscriber->func(eventname, eventdata, subscriber->data);
+    }
+  }
+  dispatch_stop = outer_stop;
+
+  return stop;
+}
+
+
+/* deliver an event to the listeners of 'level' (whose slot for this
+   event is 'index', or -1 if it has none) and then up its parent chain.
+   'key' is the event name's hash, which is the same at every level. */
+static void
+trigger_bubble(Trigger *level,
+	       int index,
+	       const char *const eventname,
+	       const unsigned char key,
+	       const void *const eventdata)
+{
+  for (;;) {
+    if (index >= 0 && trigger_dispatch(level, index, eventname, eventdata)) {
+      /* a listener stopped propagation */
+      return;
+    }
+
+    level = level->parent;
+    if (NULL == level || listenertriggerEventNameIsPrivate(eventname)) {
+      return;
+    }
+    index = find_event_slot(level, eventname, key);
+  }
+}
+
+
 void
 triggerEvent(Trigger *const trigger,
 	     const char *const eventname,
 	     const void *const eventdata)
 {
-  int i;
-  int index;
+  const unsigned char key =
+    name32_to_hash_key8(eventname) % TRIGGER_TABLE_SIZE;
 
 #ifdef TRIGGER_DEBUG
   /*
@@ -241,28 +459,75 @@ triggerEvent(Trigger *const trigger,
   */
 #endif
 
-  if (0 == find_name_slot(trigger, eventname, &index)) {
-    /* no-one is listening for this event type */
-    return;
-  }
+  trigger_bubble(trigger, find_event_slot(trigger, eventname, key),
+		 eventname, key, eventdata);
+}
 
-  /* iterate through our possibly-sparse listener list for this event
-     type, sending the event to each listener. */
-  for (i=0; i<trigger->event[index].allocated_listeners; ++i) {
-    if (NULL != trigger->event[index].listeners[i]) {
-      send_event_to_listener(trigger->event[index].listeners[i],
-			     eventname, eventdata);
+
+void
+triggerEventMulti(Trigger *const *const triggers,
+		  const int num_triggers,
+		  const char *const eventname,
+		  const void *const eventdata)
+{
+  int base, i;
+  int index[TRIGGER_MULTI_BATCH];
+  const unsigned char key =
+    name32_to_hash_key8(eventname) % TRIGGER_TABLE_SIZE;
+
+  for (base=0; base<num_triggers; base+=TRIGGER_MULTI_BATCH) {
+    const int n = num_triggers - base < TRIGGER_MULTI_BATCH
+      ? num_triggers - base : TRIGGER_MULTI_BATCH;
+
+    /* find the event's slot on each trigger in the batch, fetching the
+       next trigger's home slot and the found slot's listener list into
+       the cache while we're busy with something else. */
+    for (i=0; i<n; ++i) {
+      Trigger *const trigger = triggers[base + i];
+      if (base + i + 1 < num_triggers) {
+	TRIGGER_PREFETCH(&triggers[base + i + 1]->event[key]);
+      }
+      index[i] = find_event_slot(trigger, eventname, key);
+      if (index[i] >= 0) {
+	TRIGGER_PREFETCH(trigger->event[index[i]].listeners);
+      }
+    }
+
+    for (i=0; i<n; ++i) {
+      Trigger *const trigger = triggers[base + i];
+      /* an earlier delivery may have changed this trigger's listeners,
+	 so check that the slot is still the one we want, and look again
+	 if there wasn't one (the lookup cache makes that cheap). */
+      if (index[i] < 0 ||
+	  !eventname_equals(trigger->event[index[i]].name, eventname)) {
+	index[i] = find_event_slot(trigger, eventname, key);
+      }
+      trigger_bubble(trigger, index[i], eventname, key, eventdata);
     }
   }
 }
 
 
-static void
+/* returns 1 if the listener was already registered for this event type
+   on this trigger, else 0. */
+static int
 trigger_add_listener(Trigger *const trigger,
 		     const char *const eventname,
 		     Listener *const listener)
 {
   int index;
+  TriggerSubscriber subscriber;
+
+  /* listeners only hear about trigger deletion through
+     listener_disregard_trigger(), never through their callback */
+  if (eventname_equals(eventname, TRIGGER_DELETION_EVENT_NAME)) {
+    subscriber.func = NULL;
+    subscriber.data = NULL;
+  } else {
+    subscriber.func = listener->receptor_func;
+    subscriber.data = listener->data;
+  }
+  subscriber.listener = listener;
 
   if (0 == find_name_slot(trigger, eventname, &index)) {
     /* this event type does not yet exist on the trigger; create it,
@@ -274,14 +539,16 @@ trigger_add_listener(Trigger *const trigger,
 #ifdef TRIGGER_WARNING
       fprintf(stderr, "Event table full, so could not add listener.\n");
 #endif
-      return;
+      return 0;
     }
 
     memcpy(trigger->event[index].name, eventname, 4);
+    trigger_forget_lookups(trigger);
     trigger->event[index].num_listeners       = 1;
     trigger->event[index].allocated_listeners = 1;
-    trigger->event[index].listeners           = malloc(sizeof(Listener*));
-    trigger->event[index].listeners[0]        = listener;
+    trigger->event[index].listeners           =
+      malloc(sizeof(TriggerSubscriber));
+    trigger->event[index].listeners[0]        = subscriber;
   } else {
     /* event type exists; add listener to the listener list for
        that event type if that listener is not already in there. */
@@ -289,30 +556,32 @@ trigger_add_listener(Trigger *const trigger,
     int free_listener_slot = -1;
     i = trigger->event[index].allocated_listeners;
     while (i--) {
-      if (trigger->event[index].listeners[i] == listener) {
+      if (trigger->event[index].listeners[i].listener == listener) {
 	/* this listener is already registered for this event, so return */
-	return;
+	return 1;
       }
-      if (NULL == trigger->event[index].listeners[i]) {
+      if (NULL == trigger->event[index].listeners[i].listener) {
 	free_listener_slot = i;
       }
     }
     if (free_listener_slot > -1) {
       /* we can just plonk the listener in an allocated-but-spare slot
 	 and return */
-      trigger->event[index].listeners[free_listener_slot] = listener;
+      trigger->event[index].listeners[free_listener_slot] = subscriber;
     } else {
       /* have to expand the listener list and put the listener at the end */
       ++trigger->event[index].allocated_listeners;
       trigger->event[index].listeners =
 	realloc(trigger->event[index].listeners,
-		sizeof(Listener*) * trigger->event[index].allocated_listeners);
+		sizeof(TriggerSubscriber)
+		* trigger->event[index].allocated_listeners);
       trigger->event[index].listeners
-	[trigger->event[index].allocated_listeners - 1] = listener;
+	[trigger->event[index].allocated_listeners - 1] = subscriber;
     }
     ++trigger->event[index].num_listeners;
   }
 
+  return 0;
 }
 
 
@@ -359,18 +628,49 @@ listener_add_trigger(Listener *listener,
 }
 
 
+/* compact the listener's possibly-sparse trigger list and make room for
+   at least 'extra' more triggers.  Afterwards the vacant slots are exactly
+   those from num_triggers to allocated_triggers, so a batch of triggers
+   which are known to be new to this listener can simply be appended. */
+static void
+listener_reserve_triggers(Listener *const listener,
+			  const int extra)
+{
+  int i;
+  int n = 0;
+  const int wanted = listener->num_triggers + extra;
+
+  for (i=0; i<listener->allocated_triggers; ++i) {
+    if (NULL != listener->triggers[i]) {
+      listener->triggers[n++] = listener->triggers[i];
+    }
+  }
+
+  if (wanted > listener->allocated_triggers) {
+    listener->triggers =
+      realloc(listener->triggers, sizeof(Trigger*) * wanted);
+    listener->allocated_triggers = wanted;
+  }
+
+  for (i=n; i<listener->allocated_triggers; ++i) {
+    listener->triggers[i] = NULL;
+  }
+}
+
+
 static void
 trigger_remove_listenerlist_index(Trigger *trigger,
 				  int slot,
 				  int listindex)
 {
 #ifdef TRIGGER_DEBUG
-  if (NULL == trigger->event[slot].listeners[listindex]) {
+  if (NULL == trigger->event[slot].listeners[listindex].listener) {
     fprintf(stderr, "trigger_remove_listenerlist_index: trigger->event[slot].listeners[listindex] was already NULL.\n");
   }
 #endif
 
-  trigger->event[slot].listeners[listindex] = NULL;
+  trigger->event[slot].listeners[listindex].func = NULL;
+  trigger->event[slot].listeners[listindex].listener = NULL;
   --trigger->event[slot].num_listeners;
   /* if we just removed the last listener for this event type then
      delete this event slot. */
@@ -384,6 +684,7 @@ trigger_remove_listenerlist_index(Trigger *trigger,
 	    );
 #endif
     trigger->event[slot].name[0] = '\0';
+    trigger_forget_lookups(trigger);
     trigger->event[slot].allocated_listeners = 0;
     free(trigger->event[slot].listeners);
     trigger->event[slot].listeners = NULL;
@@ -404,7 +705,7 @@ triggerUnlisten(Trigger *const trigger,
   } else {
     int i = trigger->event[index].allocated_listeners;
     while (i--) {
-      if (trigger->event[index].listeners[i] == listener) {
+      if (trigger->event[index].listeners[i].listener == listener) {
 	trigger_remove_listenerlist_index(trigger, index, i);
         return 1;
       }
@@ -432,6 +733,57 @@ triggerListen(Trigger *const trigger,
 }
 
 
+void
+triggerListenMany(Trigger *const trigger,
+		  const char *const *const eventnames,
+		  const int num_eventnames,
+		  Listener *const listener)
+{
+  int i;
+
+  if (num_eventnames <= 0)
+    return;
+
+  /* the deletion link and back-reference only need making once for
+     the whole batch. */
+  if (0 == trigger_add_listener(trigger, TRIGGER_DELETION_EVENT_NAME,
+				listener)) {
+    listener_add_trigger(listener, trigger);
+  }
+
+  for (i=0; i<num_eventnames; ++i) {
+    trigger_add_listener(trigger, eventnames[i], listener);
+  }
+}
+
+
+void
+triggerListenMulti(Trigger *const *const triggers,
+		   const int num_triggers,
+		   const char *const eventname,
+		   Listener *const listener)
+{
+  int i;
+
+  if (num_triggers <= 0)
+    return;
+
+  /* size the listener's trigger list once for the whole batch */
+  listener_reserve_triggers(listener, num_triggers);
+
+  for (i=0; i<num_triggers; ++i) {
+    /* a listener is on a trigger's deletion list exactly when the
+       trigger is on the listener's trigger list, so there's no need
+       to scan the latter for duplicates. */
+    if (0 == trigger_add_listener(triggers[i], TRIGGER_DELETION_EVENT_NAME,
+				  listener)) {
+      listener->triggers[listener->num_triggers++] = triggers[i];
+    }
+    trigger_add_listener(triggers[i], eventname, listener);
+  }
+}
+
+
 /* make trigger forget all references to the given listener */
 static void
 trigger_disregard_listener(Trigger *trigger,
@@ -443,7 +795,7 @@ trigger_disregard_listener(Trigger *trigger,
       int s;
       for (s=0; s<trigger->event[i].allocated_listeners; ++s) {
 	/*fprintf(stderr, "%d:%d ", i, s);*/
-	if (trigger->event[i].listeners[s] == listener) {
+	if (trigger->event[i].listeners[s].listener == listener) {
 	  trigger_remove_listenerlist_index(trigger, i, s);
 	  /* can stop searching list since listeners are unique per event */
 	  break;
@@ -454,6 +806,41 @@ trigger_disregard_listener(Trigger *trigger,
 }
 
 
+int
+triggerSetParent(Trigger *const trigger,
+		 Trigger *const parent)
+{
+  const Trigger *ancestor;
+
+  for (ancestor = parent; NULL != ancestor; ancestor = ancestor->parent) {
+    if (ancestor == trigger) {
+#ifdef TRIGGER_DEBUG
+      fprintf(stderr, "triggerSetParent: refusing to make a loop.\n");
+#endif
+      return 0;
+    }
+  }
+
+  listenerUnlistenAll(&trigger->parent_link);
+  trigger->parent = parent;
+  if (NULL != parent) {
+    /* only the deletion link is wanted, which triggerListen() makes
+       anyway. */
+    triggerListen(parent, TRIGGER_DELETION_EVENT_NAME,
+		  &trigger->parent_link);
+  }
+
+  return 1;
+}
+
+
+Trigger*
+triggerGetParent(const Trigger *const trigger)
+{
+  return trigger->parent;
+}
+
+
 /****************************************************/
 
 static void
@@ -479,12 +866,16 @@ listener_disregard_trigger(Listener *const listener,
 	     the last trigger means that the listener should now be
 	     freed! */
 	  /* 2 == free_on_delete, we'll just free the listener and
-	     that's that. */
+	     that's that -- or, if it was set up with listenerInit()
+	     inside something else, just tidy it up. */
 	  if (listener->auto_delete == 2) {
 #ifdef TRIGGER_DEBUG
-	    fprintf(stderr, "{auto-deleting innerlistener %p} ", listener);
+	    fprintf(stderr, "{auto-deleting listener %p} ", listener);
 #endif
 	    listener_really_delete_inner(listener);
+	    if (listener->allocated) {
+	      free(listener);
+	    }
 	  } else
 	    /* 1 == !free_on_delete, so the listener gets sent the
 	       LISTENER_AUTODELETION_EVENT_NAME event with itself as payload
@@ -518,6 +909,10 @@ listenerInit(Listener *const listener)
   listener->receptor_func = NULL;
   listener->data = NULL;
   listener->auto_delete = 0;
+  listener->allocated = 0;
+
+  listener->handle_table = NULL;
+  listener->handle = TRIGGER_NULL_HANDLE;
 }
 
 Listener*
@@ -526,21 +921,17 @@ listenerNew(void)
   Listener* rtn = malloc(sizeof(Listener));
 
   listenerInit(rtn);
+  rtn->allocated = 1;
 
   return rtn;
 }
 
 
+/* tell all triggers which we've registered with to forget about us,
+   and forget about them in turn. */
 static void
-listener_really_delete_inner(Listener *const listener)
+listener_forget_triggers(Listener *const listener)
 {
-  /* First, send the listener its destructor event so it can do what it
-     needs to free up its 'data' hook if desired. */
-  send_event_to_listener(listener, LISTENER_DELETION_EVENT_NAME,
-			 listener->data);
-  listener->data = NULL;
-
-  /* tell all triggers which we've registered with to forget about us. */
   if (listener->num_triggers) {
     int i;
     for (i=0; i<listener->allocated_triggers; ++i) {
@@ -554,6 +945,27 @@ listener_really_delete_inner(Listener *const listener)
   if (listener->allocated_triggers) {
     free(listener->triggers);
   }
+  listener->num_triggers =
+    listener->allocated_triggers = 0;
+  listener->triggers = NULL;
+}
+
+
+static void
+listener_really_delete_inner(Listener *const listener)
+{
+  /* First, send the listener its destructor event so it can do what it
+     needs to free up its 'data' hook if desired. */
+  send_event_to_listener(listener, LISTENER_DELETION_EVENT_NAME,
+			 listener->data);
+  listener->data = NULL;
+
+  listener_forget_triggers(listener);
+
+  if (listener->handle_table) {
+    handle_table_release(listener->handle_table, listener->handle);
+    listener->handle_table = NULL;
+  }
 }
 
 
@@ -598,6 +1010,15 @@ listenerDelete(Listener *const listener)
 }
 
 
+void
+listenerUnlistenAll(Listener *const listener)
+{
+  /* note that this is not a deletion, so it never counts towards
+     auto-deletion; the listener simply ends up watching nothing. */
+  listener_forget_triggers(listener);
+}
+
+
 Listener*
 listenerAllowAutoDelete(Listener *const listener,
 			const int free_on_delete)
@@ -610,6 +1031,18 @@ listenerAllowAutoDelete(Listener *const listener,
 }
 
 
+void
+listenerStopPropagation(Listener *const listener)
+{
+  /* the listener is whichever one's callback is running, so it's the
+     delivery in progress that needs telling. */
+  (void)listener;
+  if (NULL != dispatch_stop) {
+    *dispatch_stop = 1;
+  }
+}
+
+
 int
 listenertriggerEventNameIsPrivate(const char *const eventname) {
   return eventname_equals(eventname, LISTENER_DELETION_EVENT_NAME)
@@ -618,11 +1051,45 @@ listenertriggerEventNameIsPrivate(const char *const eventname) {
 }
 
 
+/* refresh the copies of the listener's callback and data held in the
+   listener lists of all the triggers it's registered with.  This is about
+   as expensive as listenerUnlistenAll(), so it's best to set a listener
+   up before it starts listening. */
+static void
+listener_update_subscribers(Listener *const listener)
+{
+  int t, e, s;
+
+  for (t=0; t<listener->allocated_triggers; ++t) {
+    Trigger *const trigger = listener->triggers[t];
+    if (NULL == trigger)
+      continue;
+    for (e=0; e<TRIGGER_TABLE_SIZE; ++e) {
+      if ('\0' == trigger->event[e].name[0] ||
+	  eventname_equals(trigger->event[e].name,
+			   TRIGGER_DELETION_EVENT_NAME))
+	continue;
+      for (s=0; s<trigger->event[e].allocated_listeners; ++s) {
+	if (trigger->event[e].listeners[s].listener == listener) {
+	  trigger->event[e].listeners[s].func = listener->receptor_func;
+	  trigger->event[e].listeners[s].data = listener->data;
+	  /* listeners are unique per event */
+	  break;
+	}
+      }
+    }
+  }
+}
+
+
 Listener*
 listenerSetFunction(Listener *const listener,
 		    LFunction *const func)
 {
   listener->receptor_func = func;
+  if (listener->num_triggers) {
+    listener_update_subscribers(listener);
+  }
   return listener;
 }
 
@@ -631,6 +1098,9 @@ listenerSetData(Listener *const listener,
 		void *const listener_data)
 {
   listener->data = listener_data;
+  if (listener->num_triggers) {
+    listener_update_subscribers(listener);
+  }
   return listener;
 }
 
@@ -639,3 +1109,1223 @@ listenerGetData(Listener *const listener)
 {
   return listener->data;
 }
+
+
+/****************************************************/
+
+/* A scheduled event.  It lives on two intrusive doubly-linked lists at
+   once -- a wheel slot, and its trigger's list of pending events -- so
+   that it can be unlinked from either in O(1). */
+struct _TriggerTimer {
+  TriggerTimer* next;
+  TriggerTimer** prev_next;
+  TriggerTimer* trigger_next;
+  TriggerTimer** trigger_prev_next;
+
+  Trigger* trigger;
+  unsigned long expiry;
+  char name[4];
+  const void* eventdata; /* points after the struct if we own a copy */
+
+  TriggerWheel* wheel;
+  TriggerTimerHandle handle; /* TRIGGER_NULL_HANDLE if it didn't get one */
+};
+
+#define WHEEL_SLOTS (1UL << TRIGGER_WHEEL_BITS)
+#define WHEEL_LEVEL_SPAN(level) (1UL << (TRIGGER_WHEEL_BITS * (level)))
+
+
+static void
+timer_unlink(TriggerTimer *const timer)
+{
+  *timer->prev_next = timer->next;
+  if (timer->next) {
+    timer->next->prev_next = timer->prev_next;
+  }
+
+  *timer->trigger_prev_next = timer->trigger_next;
+  if (timer->trigger_next) {
+    timer->trigger_next->trigger_prev_next = timer->trigger_prev_next;
+  }
+}
+
+
+/* give the timer a handle, or TRIGGER_NULL_HANDLE if the wheel has run
+   out of them.  Free slots are reused oldest first, as in
+   handle_table_add(), so that generations wrap as slowly as possible. */
+static TriggerTimerHandle
+wheel_add_handle(TriggerWheel *const wheel,
+		 TriggerTimer *const timer)
+{
+  unsigned long index;
+
+  if (wheel->free_head == wheel->num_handle_slots) {
+    /* no free slots; grow */
+    unsigned long i;
+    unsigned long size =
+      wheel->num_handle_slots ? 2 * wheel->num_handle_slots : 64;
+
+    if (wheel->num_handle_slots > HANDLE_INDEX_MASK)
+      return TRIGGER_NULL_HANDLE;
+    if (size > HANDLE_INDEX_MASK + 1)
+      size = HANDLE_INDEX_MASK + 1;
+
+    wheel->handle_slot =
+      realloc(wheel->handle_slot, sizeof(*wheel->handle_slot) * size);
+    for (i=wheel->num_handle_slots; i<size; ++i) {
+      wheel->handle_slot[i].timer = NULL;
+      wheel->handle_slot[i].generation = 1;
+      wheel->handle_slot[i].next_free = i + 1;
+    }
+    wheel->free_head = wheel->num_handle_slots;
+    wheel->free_tail = size - 1;
+    wheel->num_handle_slots = size;
+  }
+
+  index = wheel->free_head;
+  wheel->free_head = wheel->handle_slot[index].next_free;
+  if (wheel->free_head == wheel->num_handle_slots) {
+    wheel->free_tail = wheel->num_handle_slots;
+  } else {
+    /* going oldest first means the next slot is probably long out of
+       the cache; start fetching it for next time */
+    TRIGGER_PREFETCH(&wheel->handle_slot[wheel->free_head]);
+  }
+  wheel->handle_slot[index].timer = timer;
+
+  return (wheel->handle_slot[index].generation << TRIGGER_HANDLE_INDEX_BITS)
+    | index;
+}
+
+
+/* the pending timer the handle refers to, or NULL if it is stale */
+static TriggerTimer*
+wheel_get_handle(const TriggerWheel *const wheel,
+		 const TriggerTimerHandle handle)
+{
+  const unsigned long index = handle & HANDLE_INDEX_MASK;
+
+  if (index >= wheel->num_handle_slots ||
+      wheel->handle_slot[index].generation
+      != handle >> TRIGGER_HANDLE_INDEX_BITS)
+    return NULL;
+
+  return wheel->handle_slot[index].timer;
+}
+
+
+/* take the timer off its lists and make its handle stale, without
+   freeing it yet */
+static void
+timer_retire(TriggerTimer *const timer)
+{
+  TriggerWheel *const wheel = timer->wheel;
+  const unsigned long index = timer->handle & HANDLE_INDEX_MASK;
+
+  timer_unlink(timer);
+  if (TRIGGER_NULL_HANDLE == timer->handle)
+    return;
+
+  wheel->handle_slot[index].timer = NULL;
+  wheel->handle_slot[index].generation =
+    (wheel->handle_slot[index].generation + 1) & HANDLE_GENERATION_MASK;
+  if (0 == wheel->handle_slot[index].generation) {
+    wheel->handle_slot[index].generation = 1;
+  }
+
+  /* append to the free list */
+  wheel->handle_slot[index].next_free = wheel->num_handle_slots;
+  if (wheel->free_tail == wheel->num_handle_slots) {
+    wheel->free_head = index;
+  } else {
+    wheel->handle_slot[wheel->free_tail].next_free = index;
+  }
+  wheel->free_tail = index;
+  timer->handle = TRIGGER_NULL_HANDLE;
+}
+
+
+/* file the timer into the wheel slot appropriate to how far in the future
+   it expires. */
+static void
+wheel_insert(TriggerWheel *const wheel,
+	     TriggerTimer *const timer)
+{
+  TriggerTimer **head;
+  unsigned long when = timer->expiry;
+  const unsigned long delta = when - wheel->now;
+  int level = 0;
+
+  while (level < TRIGGER_WHEEL_LEVELS-1 && delta >= WHEEL_LEVEL_SPAN(level+1))
+    ++level;
+
+  if (delta >= WHEEL_LEVEL_SPAN(TRIGGER_WHEEL_LEVELS)) {
+    /* beyond the wheel's horizon; park it in the furthest slot and it
+       will be re-filed from there once it is closer. */
+    when = wheel->now + WHEEL_LEVEL_SPAN(TRIGGER_WHEEL_LEVELS) - 1;
+  }
+
+  head = &wheel->slot[level]
+    [(when >> (TRIGGER_WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+  timer->next = *head;
+  if (timer->next) {
+    timer->next->prev_next = &timer->next;
+  }
+  timer->prev_next = head;
+  *head = timer;
+}
+
+
+/* move a wheel slot's timers into the local list 'list', so that the slot
+   can be refilled while we walk them. */
+static void
+wheel_take_slot(TriggerTimer **const slot,
+		TriggerTimer **const list)
+{
+  *list = *slot;
+  *slot = NULL;
+  if (*list) {
+    (*list)->prev_next = list;
+  }
+}
+
+
+void
+triggerWheelInit(TriggerWheel *const wheel)
+{
+  int level;
+  unsigned long i;
+
+  wheel->now = 0;
+  for (level=0; level<TRIGGER_WHEEL_LEVELS; ++level) {
+    for (i=0; i<WHEEL_SLOTS; ++i) {
+      wheel->slot[level][i] = NULL;
+    }
+  }
+  wheel->handle_slot = NULL;
+  wheel->num_handle_slots = wheel->free_head = wheel->free_tail = 0;
+}
+
+TriggerWheel*
+triggerWheelNew(void)
+{
+  TriggerWheel* rtn = malloc(sizeof(TriggerWheel));
+
+  triggerWheelInit(rtn);
+
+  return rtn;
+}
+
+
+void
+triggerWheelDeleteInner(TriggerWheel *const wheel)
+{
+  int level;
+  unsigned long i;
+
+  for (level=0; level<TRIGGER_WHEEL_LEVELS; ++level) {
+    for (i=0; i<WHEEL_SLOTS; ++i) {
+      while (wheel->slot[level][i]) {
+	TriggerTimer *const timer = wheel->slot[level][i];
+	timer_unlink(timer);
+	free(timer);
+      }
+    }
+  }
+  free(wheel->handle_slot);
+}
+
+
+void
+triggerWheelDelete(TriggerWheel *const wheel)
+{
+  triggerWheelDeleteInner(wheel);
+  free(wheel);
+}
+
+
+TriggerTimerHandle
+triggerEventAfter(TriggerWheel *const wheel,
+		  Trigger *const trigger,
+		  const char *const eventname,
+		  const void *const eventdata,
+		  const size_t eventdata_size,
+		  const unsigned long ticks)
+{
+  TriggerTimer *const timer = malloc(sizeof(TriggerTimer) + eventdata_size);
+
+  timer->trigger = trigger;
+  timer->expiry = wheel->now + (ticks ? ticks : 1);
+  memcpy(timer->name, eventname, 4);
+  if (eventdata_size) {
+    memcpy(timer + 1, eventdata, eventdata_size);
+    timer->eventdata = timer + 1;
+  } else {
+    timer->eventdata = eventdata;
+  }
+
+  timer->trigger_next = trigger->timers;
+  if (timer->trigger_next) {
+    timer->trigger_next->trigger_prev_next = &timer->trigger_next;
+  }
+  timer->trigger_prev_next = &trigger->timers;
+  trigger->timers = timer;
+
+  wheel_insert(wheel, timer);
+
+  timer->wheel = wheel;
+  timer->handle = wheel_add_handle(wheel, timer);
+
+  return timer->handle;
+}
+
+
+int
+triggerCancelTimer(TriggerWheel *const wheel,
+		   const TriggerTimerHandle handle)
+{
+  TriggerTimer *const timer = wheel_get_handle(wheel, handle);
+
+  if (NULL == timer)
+    return 0; /* already fired or cancelled */
+
+  timer_retire(timer);
+  free(timer);
+
+  return 1;
+}
+
+
+void
+triggerTick(TriggerWheel *const wheel)
+{
+  TriggerTimer *due;
+  const TriggerTimer *pending;
+  int level;
+
+  ++wheel->now;
+
+  /* whenever a level's slot index wraps to zero, the next slot of the
+     level above falls within that level's range; spread its timers out
+     over the finer-grained levels below. */
+  for (level=1; level<TRIGGER_WHEEL_LEVELS; ++level) {
+    if (0 != (wheel->now & (WHEEL_LEVEL_SPAN(level) - 1))) {
+      break;
+    }
+    wheel_take_slot(&wheel->slot[level]
+		    [(wheel->now >> (TRIGGER_WHEEL_BITS * level))
+		     & (WHEEL_SLOTS - 1)],
+		    &due);
+    while (due) {
+      TriggerTimer *const timer = due;
+      due = timer->next;
+      wheel_insert(wheel, timer);
+    }
+  }
+
+  /* fire everything in the current level-0 slot.  A callback may delete
+     triggers (and hence cancel timers) which are still on the 'due'
+     list, which is fine since cancellation just unlinks them from it. */
+  wheel_take_slot(&wheel->slot[0][wheel->now & (WHEEL_SLOTS - 1)], &due);
+  for (pending = due; pending; pending = pending->next) {
+    /* their handles' slots are likely far out of the cache by now, so
+       get them all on their way at once */
+    TRIGGER_PREFETCH(&wheel->handle_slot
+		     [pending->handle & HANDLE_INDEX_MASK]);
+  }
+  while (due) {
+    TriggerTimer *const timer = due;
+    /* retired first, so that cancelling it from its own callback
+       finds it already gone */
+    timer_retire(timer);
+    triggerEvent(timer->trigger, timer->name, timer->eventdata);
+    free(timer);
+  }
+}
+
+
+int
+triggerCancelEvents(Trigger *const trigger,
+		    const char *const eventname)
+{
+  int cancelled = 0;
+  TriggerTimer *timer = trigger->timers;
+
+  while (timer) {
+    TriggerTimer *const next = timer->trigger_next;
+    if (NULL == eventname || eventname_equals(timer->name, eventname)) {
+      timer_retire(timer);
+      free(timer);
+      ++cancelled;
+    }
+    timer = next;
+  }
+
+  return cancelled;
+}
+
+
+/****************************************************/
+
+
+static void
+handle_table_init(TriggerHandleTable *const table)
+{
+  table->objects = NULL;
+  table->handles = NULL;
+  table->generation = NULL;
+  table->position = NULL;
+  table->num_objects = table->num_slots = 0;
+  table->free_head = table->free_tail = 0;
+}
+
+
+static void
+handle_table_free(TriggerHandleTable *const table)
+{
+  free(table->objects);
+  free(table->handles);
+  free(table->generation);
+  free(table->position);
+  handle_table_init(table);
+}
+
+
+/* returns the object the handle refers to, or NULL if it is stale (or
+   never was valid) */
+static void*
+handle_table_get(const TriggerHandleTable *const table,
+		 const unsigned long handle)
+{
+  const unsigned long index = handle & HANDLE_INDEX_MASK;
+  unsigned long position;
+
+  if (index >= table->num_slots ||
+      table->generation[index] != handle >> TRIGGER_HANDLE_INDEX_BITS)
+    return NULL;
+
+  /* a free slot's position is a free-list link, so check that it really
+     points back at this handle */
+  position = table->position[index];
+  if (position >= table->num_objects || table->handles[position] != handle)
+    return NULL;
+
+  return table->objects[position];
+}
+
+
+/* returns TRIGGER_NULL_HANDLE if the table is full */
+static unsigned long
+handle_table_add(TriggerHandleTable *const table,
+		 void *const object)
+{
+  unsigned long index, handle;
+
+  if (table->free_head == table->num_slots) {
+    /* no free slots; grow the table */
+    unsigned long i;
+    unsigned long size = table->num_slots ? 2 * table->num_slots : 64;
+
+    if (table->num_slots > HANDLE_INDEX_MASK)
+      return TRIGGER_NULL_HANDLE;
+    if (size > HANDLE_INDEX_MASK + 1)
+      size = HANDLE_INDEX_MASK + 1;
+
+    table->objects = realloc(table->objects, sizeof(void*) * size);
+    table->handles = realloc(table->handles, sizeof(unsigned long) * size);
+    table->generation =
+      realloc(table->generation, sizeof(unsigned long) * size);
+    table->position = realloc(table->position, sizeof(unsigned long) * size);
+    for (i=table->num_slots; i<size; ++i) {
+      table->generation[i] = 1;
+      table->position[i] = i + 1;
+    }
+    table->free_head = table->num_slots;
+    table->free_tail = size - 1;
+    table->num_slots = size;
+  }
+
+  /* take the oldest free slot, so that generations wrap as slowly as
+     possible */
+  index = table->free_head;
+  table->free_head = table->position[index];
+  if (table->free_head == table->num_slots) {
+    table->free_tail = table->num_slots;
+  }
+
+  handle = (table->generation[index] << TRIGGER_HANDLE_INDEX_BITS) | index;
+  table->position[index] = table->num_objects;
+  table->objects[table->num_objects] = object;
+  table->handles[table->num_objects] = handle;
+  ++table->num_objects;
+
+  return handle;
+}
+
+
+static void
+handle_table_release(TriggerHandleTable *const table,
+		     const unsigned long handle)
+{
+  const unsigned long index = handle & HANDLE_INDEX_MASK;
+  const unsigned long position = table->position[index];
+  const unsigned long last = table->num_objects - 1;
+
+  /* keep the objects dense by moving the last one into the gap */
+  table->objects[position] = table->objects[last];
+  table->handles[position] = table->handles[last];
+  table->position[table->handles[position] & HANDLE_INDEX_MASK] = position;
+  --table->num_objects;
+
+  /* a new generation makes any outstanding handles to this slot stale;
+     generation 0 is skipped so that no handle is ever 0 */
+  table->generation[index] = (table->generation[index] + 1)
+    & HANDLE_GENERATION_MASK;
+  if (0 == table->generation[index]) {
+    table->generation[index] = 1;
+  }
+
+  /* append to the free list */
+  table->position[index] = table->num_slots;
+  if (table->free_tail == table->num_slots) {
+    table->free_head = index;
+  } else {
+    table->position[table->free_tail] = index;
+  }
+  table->free_tail = index;
+}
+
+
+void
+triggerHandlesInit(TriggerHandles *const handles)
+{
+  handle_table_init(&handles->triggers);
+  handle_table_init(&handles->listeners);
+}
+
+TriggerHandles*
+triggerHandlesNew(void)
+{
+  TriggerHandles* rtn = malloc(sizeof(TriggerHandles));
+
+  triggerHandlesInit(rtn);
+
+  return rtn;
+}
+
+
+void
+triggerHandlesDeleteInner(TriggerHandles *const handles)
+{
+  /* listeners first, so that deleting the triggers doesn't set off any
+     auto-deletions.  Each deletion removes the object from the end of the
+     dense array. */
+  while (handles->listeners.num_objects) {
+    Listener *const listener =
+      handles->listeners.objects[handles->listeners.num_objects - 1];
+    listener_really_delete_inner(listener);
+    free(listener);
+  }
+  while (handles->triggers.num_objects) {
+    triggerDelete(handles->triggers.objects[handles->triggers.num_objects-1]);
+  }
+
+  handle_table_free(&handles->listeners);
+  handle_table_free(&handles->triggers);
+}
+
+
+void
+triggerHandlesDelete(TriggerHandles *const handles)
+{
+  triggerHandlesDeleteInner(handles);
+  free(handles);
+}
+
+
+TriggerHandle
+triggerHandleNew(TriggerHandles *const handles)
+{
+  Trigger *const trigger = triggerNew();
+
+  trigger->handle = handle_table_add(&handles->triggers, trigger);
+  if (TRIGGER_NULL_HANDLE == trigger->handle) {
+    triggerDelete(trigger);
+    return TRIGGER_NULL_HANDLE;
+  }
+  trigger->handle_table = &handles->triggers;
+
+  return trigger->handle;
+}
+
+
+Trigger*
+triggerHandleGet(const TriggerHandles *const handles,
+		 const TriggerHandle handle)
+{
+  return handle_table_get(&handles->triggers, handle);
+}
+
+
+void
+triggerHandleDelete(TriggerHandles *const handles,
+		    const TriggerHandle handle)
+{
+  Trigger *const trigger = triggerHandleGet(handles, handle);
+
+  if (trigger) {
+    triggerDelete(trigger);
+  }
+}
+
+
+TriggerHandle
+triggerGetHandle(const Trigger *const trigger)
+{
+  return trigger->handle;
+}
+
+
+int
+triggerHandlesNumTriggers(const TriggerHandles *const handles)
+{
+  return (int)handles->triggers.num_objects;
+}
+
+
+Trigger*
+triggerHandlesTrigger(const TriggerHandles *const handles,
+		      const int index)
+{
+  return handles->triggers.objects[index];
+}
+
+
+ListenerHandle
+listenerHandleNew(TriggerHandles *const handles)
+{
+  Listener *const listener = listenerNew();
+
+  listener->handle = handle_table_add(&handles->listeners, listener);
+  if (TRIGGER_NULL_HANDLE == listener->handle) {
+    free(listener);
+    return TRIGGER_NULL_HANDLE;
+  }
+  listener->handle_table = &handles->listeners;
+
+  return listener->handle;
+}
+
+
+Listener*
+listenerHandleGet(const TriggerHandles *const handles,
+		  const ListenerHandle handle)
+{
+  return handle_table_get(&handles->listeners, handle);
+}
+
+
+void
+listenerHandleDelete(TriggerHandles *const handles,
+		     const ListenerHandle handle)
+{
+  Listener *const listener = listenerHandleGet(handles, handle);
+
+  /* no need for listenerDelete()'s auto-delete warning here; if the
+     listener had already auto-deleted then we wouldn't have found it. */
+  if (listener) {
+    listener_really_delete_inner(listener);
+    free(listener);
+  }
+}
+
+
+ListenerHandle
+listenerGetHandle(const Listener *const listener)
+{
+  return listener->handle;
+}
+
+
+int
+listenerHandlesNumListeners(const TriggerHandles *const handles)
+{
+  return (int)handles->listeners.num_objects;
+}
+
+
+Listener*
+listenerHandlesListener(const TriggerHandles *const handles,
+			const int index)
+{
+  return handles->listeners.objects[index];
+}
+
+
+/****************************************************/
+
+/* Snapshot format.  All integers are unsigned, little-endian, and 32 bits
+   wide unless noted.
+
+     "TGrf" version table_size num_triggers num_listeners
+     for each listener:
+       function_index (GRAPH_NONE if none)   auto_delete (8 bits)
+     for each trigger:
+       parent_index (GRAPH_NONE if none)   num_slots
+       for each used event slot:
+	 slot_index   name (4 chars)   num_listeners   listener_index...
+
+   Slots are saved at their hashed position so that loading needs no
+   probing, and listener lists are saved without their holes. */
+
+#define GRAPH_MAGIC   "TGrf"
+#define GRAPH_VERSION 1
+#define GRAPH_NONE    0xFFFFFFFFUL
+
+
+typedef struct {
+  unsigned char *buffer;
+  size_t size;
+  size_t pos;
+} GraphWriter;
+
+static void
+graph_put_u32(GraphWriter *const writer,
+	      const unsigned long value)
+{
+  if (writer->pos + 4 <= writer->size) {
+    unsigned char *const p = writer->buffer + writer->pos;
+    p[0] = (unsigned char)(value      );
+    p[1] = (unsigned char)(value >>  8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+  }
+  writer->pos += 4;
+}
+
+static void
+graph_put_bytes(GraphWriter *const writer,
+		const void *const bytes,
+		const size_t count)
+{
+  if (writer->pos + count <= writer->size) {
+    memcpy(writer->buffer + writer->pos, bytes, count);
+  }
+  writer->pos += count;
+}
+
+
+typedef struct {
+  const unsigned char *buffer;
+  size_t size;
+  size_t pos;
+} GraphReader;
+
+/* returns 0 if we've run off the end of the buffer */
+static int
+graph_get_u32(GraphReader *const reader,
+	      unsigned long *const value)
+{
+  const unsigned char *p;
+
+  if (reader->size - reader->pos < 4)
+    return 0;
+
+  p = reader->buffer + reader->pos;
+  *value =
+    ((unsigned long)p[0]      ) |
+    ((unsigned long)p[1] <<  8) |
+    ((unsigned long)p[2] << 16) |
+    ((unsigned long)p[3] << 24);
+  reader->pos += 4;
+  return 1;
+}
+
+static const unsigned char*
+graph_get_bytes(GraphReader *const reader,
+		const size_t count)
+{
+  const unsigned char *p;
+
+  if (reader->size - reader->pos < count)
+    return NULL;
+
+  p = reader->buffer + reader->pos;
+  reader->pos += count;
+  return p;
+}
+
+
+/* A small open-addressed pointer -> index map, so that saving a large
+   graph doesn't need a linear search per listener reference. */
+typedef struct {
+  const void *ptr;
+  unsigned long index;
+} PtrIndex;
+
+static unsigned long
+ptr_index_hash(const void *const ptr,
+	       const unsigned long mask)
+{
+  const unsigned long p = (unsigned long)(size_t)ptr;
+  return ((p >> 4) ^ (p >> 13)) * 2654435761UL & mask;
+}
+
+static PtrIndex*
+ptr_index_new(const void *const *const ptrs,
+	      const int num_ptrs,
+	      unsigned long *const mask)
+{
+  int i;
+  unsigned long size = 16;
+  PtrIndex *map;
+
+  while (size < 2UL * num_ptrs)
+    size <<= 1;
+  *mask = size - 1;
+
+  map = malloc(sizeof(PtrIndex) * size);
+  for (i=0; i<(int)size; ++i) {
+    map[i].ptr = NULL;
+  }
+
+  for (i=0; i<num_ptrs; ++i) {
+    unsigned long h = ptr_index_hash(ptrs[i], *mask);
+    while (NULL != map[h].ptr && map[h].ptr != ptrs[i])
+      h = (h + 1) & *mask;
+    if (NULL == map[h].ptr) {
+      map[h].ptr = ptrs[i];
+      map[h].index = i;
+    }
+  }
+
+  return map;
+}
+
+/* returns GRAPH_NONE if the pointer isn't in the map */
+static unsigned long
+ptr_index_find(const PtrIndex *const map,
+	       const unsigned long mask,
+	       const void *const ptr)
+{
+  unsigned long h = ptr_index_hash(ptr, mask);
+
+  while (NULL != map[h].ptr) {
+    if (map[h].ptr == ptr)
+      return map[h].index;
+    h = (h + 1) & mask;
+  }
+  return GRAPH_NONE;
+}
+
+
+size_t
+triggerGraphSave(Trigger *const *const triggers,
+		 const int num_triggers,
+		 Listener *const *const listeners,
+		 const int num_listeners,
+		 LFunction *const *const functions,
+		 const int num_functions,
+		 void *const buffer,
+		 const size_t buffer_size)
+{
+  GraphWriter writer;
+  unsigned long trigger_mask, listener_mask;
+  PtrIndex *trigger_map =
+    ptr_index_new((const void *const *)triggers, num_triggers,
+		  &trigger_mask);
+  PtrIndex *listener_map =
+    ptr_index_new((const void *const *)listeners, num_listeners,
+		  &listener_mask);
+  int i, f, e, l;
+
+  writer.buffer = buffer;
+  writer.size = buffer ? buffer_size : 0;
+  writer.pos = 0;
+
+  graph_put_bytes(&writer, GRAPH_MAGIC, 4);
+  graph_put_u32(&writer, GRAPH_VERSION);
+  graph_put_u32(&writer, TRIGGER_TABLE_SIZE);
+  graph_put_u32(&writer, num_triggers);
+  graph_put_u32(&writer, num_listeners);
+
+  for (i=0; i<num_listeners; ++i) {
+    unsigned long func_index = GRAPH_NONE;
+    unsigned char auto_delete = listeners[i]->auto_delete;
+    for (f=0; f<num_functions; ++f) {
+      if (functions[f] == listeners[i]->receptor_func) {
+	func_index = f;
+	break;
+      }
+    }
+#ifdef TRIGGER_DEBUG
+    if (GRAPH_NONE == func_index && NULL != listeners[i]->receptor_func) {
+      fprintf(stderr, "triggerGraphSave: listener %p's callback isn't in "
+	      "the function table.\n", listeners[i]);
+    }
+#endif
+    graph_put_u32(&writer, func_index);
+    graph_put_bytes(&writer, &auto_delete, 1);
+  }
+
+  for (i=0; i<num_triggers; ++i) {
+    const Trigger *const trigger = triggers[i];
+    size_t num_slots_pos;
+    unsigned long num_slots = 0;
+
+    graph_put_u32(&writer,
+		  trigger->parent
+		  ? ptr_index_find(trigger_map, trigger_mask, trigger->parent)
+		  : GRAPH_NONE);
+    num_slots_pos = writer.pos;
+    graph_put_u32(&writer, 0); /* num_slots, filled in below */
+
+    for (e=0; e<TRIGGER_TABLE_SIZE; ++e) {
+      size_t num_listeners_pos;
+      unsigned long num_saved = 0;
+
+      if ('\0' == trigger->event[e].name[0])
+	continue;
+
+      num_listeners_pos = writer.pos + 8;
+      graph_put_u32(&writer, e);
+      graph_put_bytes(&writer, trigger->event[e].name, 4);
+      graph_put_u32(&writer, 0); /* num_listeners, filled in below */
+      for (l=0; l<trigger->event[e].allocated_listeners; ++l) {
+	const unsigned long index =
+	  trigger->event[e].listeners[l].listener
+	  ? ptr_index_find(listener_map, listener_mask,
+			   trigger->event[e].listeners[l].listener)
+	  : GRAPH_NONE;
+	if (GRAPH_NONE != index) {
+	  graph_put_u32(&writer, index);
+	  ++num_saved;
+	}
+      }
+
+      if (0 == num_saved) {
+	/* nobody we're saving listens for this; drop the slot */
+	writer.pos = num_listeners_pos - 8;
+      } else {
+	const size_t end = writer.pos;
+	writer.pos = num_listeners_pos;
+	graph_put_u32(&writer, num_saved);
+	writer.pos = end;
+	++num_slots;
+      }
+    }
+
+    {
+      const size_t end = writer.pos;
+      writer.pos = num_slots_pos;
+      graph_put_u32(&writer, num_slots);
+      writer.pos = end;
+    }
+  }
+
+  free(listener_map);
+  free(trigger_map);
+
+  return writer.pos;
+}
+
+
+/* reads and sanity-checks a snapshot's header */
+static int
+graph_read_header(GraphReader *const reader,
+		  unsigned long *const num_triggers,
+		  unsigned long *const num_listeners)
+{
+  const unsigned char *magic = graph_get_bytes(reader, 4);
+  unsigned long version, table_size;
+
+  return NULL != magic && 0 == memcmp(magic, GRAPH_MAGIC, 4)
+    && graph_get_u32(reader, &version) && GRAPH_VERSION == version
+    && graph_get_u32(reader, &table_size) && TRIGGER_TABLE_SIZE == table_size
+    && graph_get_u32(reader, num_triggers) && *num_triggers < 0x7FFFFFFFUL
+    && graph_get_u32(reader, num_listeners) && *num_listeners < 0x7FFFFFFFUL
+    /* each listener takes at least 5 bytes and each trigger 8, so don't
+       believe counts which couldn't possibly fit */
+    && (reader->size - reader->pos) / 5 >= *num_listeners
+    && (reader->size - reader->pos - 5 * *num_listeners) / 8 >= *num_triggers;
+}
+
+
+int
+triggerGraphInfo(const void *const buffer,
+		 const size_t buffer_size,
+		 int *const num_triggers,
+		 int *const num_listeners)
+{
+  GraphReader reader;
+  unsigned long nt, nl;
+
+  reader.buffer = buffer;
+  reader.size = buffer_size;
+  reader.pos = 0;
+
+  if (!graph_read_header(&reader, &nt, &nl))
+    return 0;
+
+  *num_triggers = (int)nt;
+  *num_listeners = (int)nl;
+  return 1;
+}
+
+
+/* Walks a whole snapshot checking that it describes a graph we can safely
+   build: everything in bounds, no duplicate slots, names or listeners,
+   and every listener of a trigger also on that trigger's deletion list.
+   'stamp' has room for one entry per listener.  Also counts, into
+   'num_links', how many triggers each listener will be watching, and
+   copies each trigger's parent index into 'parents'. */
+static int
+graph_validate(GraphReader *const reader,
+	       const unsigned long num_triggers,
+	       const unsigned long num_listeners,
+	       const int num_functions,
+	       unsigned long *const stamp,
+	       unsigned short *const num_links,
+	       unsigned long *const parents)
+{
+  unsigned long i, s, l, value;
+  unsigned long next_stamp = 0;
+  char seen_names[TRIGGER_TABLE_SIZE][4];
+
+  for (i=0; i<num_listeners; ++i) {
+    const unsigned char *auto_delete;
+    if (!graph_get_u32(reader, &value) ||
+	(GRAPH_NONE != value && value >= (unsigned long)num_functions) ||
+	NULL == (auto_delete = graph_get_bytes(reader, 1)) ||
+	*auto_delete > 2)
+      return 0;
+    stamp[i] = 0;
+    num_links[i] = 0;
+  }
+
+  for (i=0; i<num_triggers; ++i) {
+    unsigned long num_slots;
+    unsigned long deletion_stamp = 0;
+    size_t slots_pos;
+    char slot_used[TRIGGER_TABLE_SIZE];
+    int pass;
+
+    if (!graph_get_u32(reader, &parents[i]) ||
+	(GRAPH_NONE != parents[i] && parents[i] >= num_triggers) ||
+	!graph_get_u32(reader, &num_slots) ||
+	num_slots > TRIGGER_TABLE_SIZE)
+      return 0;
+
+    /* two passes over the trigger's slots: the first marks the listeners
+       on its deletion list, the second checks everyone else against
+       that. */
+    slots_pos = reader->pos;
+    for (pass=0; pass<2; ++pass) {
+      memset(slot_used, 0, sizeof(slot_used));
+      reader->pos = slots_pos;
+      for (s=0; s<num_slots; ++s) {
+	unsigned long slot, count;
+	const unsigned char *name;
+	int is_deletion;
+
+	if (!graph_get_u32(reader, &slot) || slot >= TRIGGER_TABLE_SIZE ||
+	    slot_used[slot] ||
+	    NULL == (name = graph_get_bytes(reader, 4)) || '\0' == name[0] ||
+	    !graph_get_u32(reader, &count) || 0 == count || count > 0xFFFF ||
+	    reader->size - reader->pos < 4 * count)
+	  return 0;
+	slot_used[slot] = 1;
+	if (0 == pass) {
+	  /* two slots with one name would leave the second unreachable */
+	  for (l=0; l<s; ++l) {
+	    if (eventname_equals(seen_names[l], (const char*)name))
+	      return 0;
+	  }
+	  memcpy(seen_names[s], name, 4);
+	}
+	is_deletion = eventname_equals((const char*)name,
+				       TRIGGER_DELETION_EVENT_NAME);
+
+	/* every slot gets its own stamp for catching duplicates */
+	++next_stamp;
+	if (is_deletion && 0 == pass) {
+	  deletion_stamp = next_stamp;
+	}
+
+	for (l=0; l<count; ++l) {
+	  graph_get_u32(reader, &value);
+	  if (value >= num_listeners)
+	    return 0;
+	  if (0 == pass) {
+	    if (is_deletion) {
+	      if (stamp[value] == deletion_stamp)
+		return 0;
+	      stamp[value] = deletion_stamp;
+	      if (0xFFFF == num_links[value])
+		return 0;
+	      ++num_links[value];
+	    }
+	  } else if (!is_deletion) {
+	    if (stamp[value] != deletion_stamp || 0 == deletion_stamp)
+	      return 0; /* not on the deletion list */
+	    /* mark as seen in this slot, remembering to put the deletion
+	       stamp back once the slot is done */
+	    stamp[value] = next_stamp;
+	  }
+	}
+
+	if (1 == pass && !is_deletion) {
+	  /* restore the deletion stamps, checking for duplicates as we
+	     go: a listener seen twice in the slot was re-stamped the first
+	     time round. */
+	  reader->pos -= 4 * count;
+	  for (l=0; l<count; ++l) {
+	    graph_get_u32(reader, &value);
+	    if (stamp[value] != next_stamp)
+	      return 0;
+	    stamp[value] = deletion_stamp;
+	  }
+	}
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+/* Returns nonzero if following 'parents' from any trigger leads back
+   round to it.  Each walk marks what it visits with its own number, so
+   a walk stops as soon as it reaches a trigger some earlier walk has
+   already cleared. */
+static int
+graph_has_parent_cycle(const unsigned long *const parents,
+		       const unsigned long num_triggers)
+{
+  unsigned long i, j;
+  unsigned long *const mark =
+    calloc(num_triggers + 1, sizeof(unsigned long));
+  int cycle = 0;
+
+  for (i=0; i<num_triggers && !cycle; ++i) {
+    for (j=i; GRAPH_NONE != j && 0 == mark[j]; j=parents[j]) {
+      mark[j] = i + 1;
+    }
+    cycle = GRAPH_NONE != j && i + 1 == mark[j];
+  }
+  free(mark);
+
+  return cycle;
+}
+
+
+int
+triggerGraphLoad(const void *const buffer,
+		 const size_t buffer_size,
+		 LFunction *const *const functions,
+		 const int num_functions,
+		 void *const *const listener_data,
+		 Trigger **const triggers,
+		 Listener **const listeners)
+{
+  GraphReader reader;
+  unsigned long num_triggers, num_listeners;
+  unsigned long i, s, l, value;
+  size_t body_pos;
+  unsigned long *stamp;
+  unsigned short *num_links;
+  unsigned long *parents;
+  int ok;
+
+  reader.buffer = buffer;
+  reader.size = buffer_size;
+  reader.pos = 0;
+
+  if (!graph_read_header(&reader, &num_triggers, &num_listeners))
+    return 0;
+
+  /* check the whole snapshot before creating anything */
+  body_pos = reader.pos;
+  stamp = malloc(sizeof(unsigned long) * (num_listeners + 1));
+  num_links = malloc(sizeof(unsigned short) * (num_listeners + 1));
+  parents = malloc(sizeof(unsigned long) * (num_triggers + 1));
+  ok = graph_validate(&reader, num_triggers, num_listeners, num_functions,
+		      stamp, num_links, parents) &&
+    !graph_has_parent_cycle(parents, num_triggers);
+  free(stamp);
+  if (!ok) {
+    free(num_links);
+    free(parents);
+    return 0;
+  }
+  reader.pos = body_pos;
+
+  /* listeners, with their trigger lists sized exactly up front */
+  for (i=0; i<num_listeners; ++i) {
+    const unsigned char *auto_delete;
+    Listener *const listener = listenerNew();
+
+    graph_get_u32(&reader, &value);
+    auto_delete = graph_get_bytes(&reader, 1);
+    listener->receptor_func = GRAPH_NONE == value ? NULL : functions[value];
+    listener->data = listener_data ? listener_data[i] : NULL;
+    listener->auto_delete = *auto_delete;
+    if (num_links[i]) {
+      listener->allocated_triggers = num_links[i];
+      listener->triggers = malloc(sizeof(Trigger*) * num_links[i]);
+    }
+    listeners[i] = listener;
+  }
+  free(num_links);
+
+  /* triggers, with each slot filled in place at its saved index */
+  for (i=0; i<num_triggers; ++i) {
+    unsigned long num_slots;
+    Trigger *const trigger = triggerNew();
+
+    graph_get_u32(&reader, &value); /* parent, already in 'parents' */
+    graph_get_u32(&reader, &num_slots);
+    for (s=0; s<num_slots; ++s) {
+      unsigned long slot, count;
+      const char *name;
+      int is_deletion;
+
+      graph_get_u32(&reader, &slot);
+      name = (const char*)graph_get_bytes(&reader, 4);
+      graph_get_u32(&reader, &count);
+      is_deletion = eventname_equals(name, TRIGGER_DELETION_EVENT_NAME);
+
+      memcpy(trigger->event[slot].name, name, 4);
+      trigger->event[slot].num_listeners =
+	trigger->event[slot].allocated_listeners = (unsigned short)count;
+      trigger->event[slot].listeners =
+	malloc(sizeof(TriggerSubscriber) * count);
+      for (l=0; l<count; ++l) {
+	Listener *listener;
+	TriggerSubscriber *const subscriber =
+	  &trigger->event[slot].listeners[l];
+	graph_get_u32(&reader, &value);
+	listener = listeners[value];
+	subscriber->listener = listener;
+	if (is_deletion) {
+	  subscriber->func = NULL;
+	  subscriber->data = NULL;
+	  listener->triggers[listener->num_triggers++] = trigger;
+	} else {
+	  subscriber->func = listener->receptor_func;
+	  subscriber->data = listener->data;
+	}
+      }
+    }
+    triggers[i] = trigger;
+  }
+
+  for (i=0; i<num_triggers; ++i) {
+    if (GRAPH_NONE != parents[i]) {
+      triggerSetParent(triggers[i], triggers[parents[i]]);
+    }
+  }
+  free(parents);
+
+  return 1;
+}
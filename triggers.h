@@ -16,12 +16,18 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifndef TRIGGERS_H
 #define TRIGGERS_H
 
+#include <stddef.h>
+
 /* note: Only the first four characters of event names are significant */
 
 /* Max number of unique event types to recognise per trigger (1..256)
    (tunable for space usage versus speed) */
 #define TRIGGER_TABLE_SIZE 256
 
+/* Number of recent event lookups (hits and misses) each trigger remembers
+   for event delivery; must be a power of two no larger than 256 */
+#define TRIGGER_LOOKUP_CACHE_SIZE 16
+
 /* some event types which the trigger system uses internally (if you
    change these then re-compile the trigger module as well as your
    own code that cares). */
@@ -29,10 +35,44 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define LISTENER_DELETION_EVENT_NAME     "_LDe"
 #define LISTENER_AUTODELETION_EVENT_NAME "_LAu"
 
+/* Scheduled events are kept in a hierarchical timing wheel of
+   TRIGGER_WHEEL_LEVELS levels, each of (1 << TRIGGER_WHEEL_BITS) slots.
+   Events further than 1 << (TRIGGER_WHEEL_BITS * TRIGGER_WHEEL_LEVELS)
+   ticks in the future are still delivered on time, but get re-filed a few
+   extra times on the way.  The product must be less than the number of
+   bits in an unsigned long. */
+#define TRIGGER_WHEEL_BITS   6
+#define TRIGGER_WHEEL_LEVELS 4
+
+
+/* Handles pack a slot index into the low TRIGGER_HANDLE_INDEX_BITS bits
+   and that slot's generation into the rest of 32 bits, so at most
+   (1 << TRIGGER_HANDLE_INDEX_BITS) objects of each kind may have handles
+   in one table, and a stale handle could only be mistaken for a live one
+   after its slot has been reused a few thousand times. */
+#define TRIGGER_HANDLE_INDEX_BITS 20
+
 
 /* trigger/listener structures */
 
 typedef struct _Trigger Trigger;
+typedef struct _TriggerTimer TriggerTimer;
+
+typedef unsigned long TriggerHandle;
+typedef unsigned long ListenerHandle;
+typedef unsigned long TriggerTimerHandle;
+#define TRIGGER_NULL_HANDLE 0 /* never a valid handle */
+
+typedef struct {
+  void** objects; /* the live objects, densely packed */
+  unsigned long* handles; /* the handle of each of 'objects' */
+  unsigned long* generation; /* per slot */
+  unsigned long* position; /* per slot: index into 'objects' if live,
+			      else the next free slot */
+  unsigned long num_objects;
+  unsigned long num_slots;
+  unsigned long free_head, free_tail; /* == num_slots if none free */
+} TriggerHandleTable;
 
 #define LFUNC_RTN   void
 #define LFUNC_PARAM const char *const eventname, \
@@ -41,25 +81,74 @@ typedef struct _Trigger Trigger;
 typedef LFUNC_RTN (LFunction)(LFUNC_PARAM);
 
 typedef struct {
+  /* hot: wanted whenever the listener is sent an event */
+  LFunction* receptor_func;
+  void *data; /* hook for listener-specific data */
+
+  /* cold: bookkeeping */
   unsigned short int num_triggers;
   unsigned short int allocated_triggers;
   Trigger** triggers;
 
-  LFunction* receptor_func;
-  void *data; /* hook for listener-specific data */
-
   char auto_delete;
+  char allocated; /* made by listenerNew(), so ours to free */
+
+  TriggerHandleTable* handle_table; /* NULL unless made by a handle call */
+  ListenerHandle handle;
 } Listener;
 
+/* An entry in a trigger's listener list.  The listener's callback and
+   data are copied in here so that delivering an event never has to look
+   at the Listener itself. */
+typedef struct {
+  LFunction* func; /* NULL for deletion-list entries */
+  void* data;
+  Listener* listener; /* NULL if this entry is vacant */
+} TriggerSubscriber;
+
 struct _Trigger {
+  struct {
+    char name[4];
+    short int index; /* -1 if no-one on this trigger listens for it */
+  } lookup[TRIGGER_LOOKUP_CACHE_SIZE]; /* indexed by the name's hash */
+
   struct {
     char name[4];
     unsigned short int num_listeners;
     unsigned short int allocated_listeners;
-    Listener** listeners;
+    TriggerSubscriber* listeners;
   } event[TRIGGER_TABLE_SIZE];
+
+  TriggerTimer* timers; /* pending scheduled events for this trigger */
+
+  Trigger* parent; /* events bubble up to here after we're done */
+  Listener parent_link; /* watches the parent for its deletion */
+
+  TriggerHandleTable* handle_table; /* NULL unless made by a handle call */
+  TriggerHandle handle;
 };
 
+typedef struct {
+  unsigned long now;
+  TriggerTimer* slot[TRIGGER_WHEEL_LEVELS][1 << TRIGGER_WHEEL_BITS];
+
+  /* handles of the pending events: slots and generations as for a
+     TriggerHandleTable, but without the dense array, which nothing needs
+     for these */
+  struct {
+    TriggerTimer* timer; /* NULL if free */
+    unsigned long generation;
+    unsigned long next_free;
+  } *handle_slot;
+  unsigned long num_handle_slots;
+  unsigned long free_head, free_tail; /* == num_handle_slots if none free */
+} TriggerWheel;
+
+typedef struct {
+  TriggerHandleTable triggers;
+  TriggerHandleTable listeners;
+} TriggerHandles;
+
 
 /* methods */
 
@@ -74,6 +163,11 @@ Listener* listenerSetData(Listener *const listener,
 void* listenerGetData(Listener *const listener);
 Listener* listenerAllowAutoDelete(Listener *const listener,
 				  const int free_on_delete);
+/* for use from a listener's own callback: once the current event has
+   been delivered to every listener on the current trigger, do not bubble
+   it up to that trigger's parent.  The callback may delete its own
+   listener as well. */
+void listenerStopPropagation(Listener *const listener);
 
 int listenertriggerEventNameIsPrivate(const char *const eventname);
 
@@ -83,6 +177,16 @@ int listenertriggerEventNameIsPrivate(const char *const eventname);
 Trigger* triggerNew(void);
 void triggerDelete(Trigger *const trigger);
 
+/* Events fired on a trigger which has a parent are also delivered to the
+   parent's listeners, and so on up the chain, unless a listener stops
+   propagation.  Private (internal) events never bubble.  A NULL parent
+   detaches the trigger.  Returns 0 (and changes nothing) if the new
+   parent would make a loop, else 1.  When a parent is deleted its children
+   are detached automatically. */
+int triggerSetParent(Trigger *const trigger,
+		     Trigger *const parent);
+Trigger* triggerGetParent(const Trigger *const trigger);
+
 void triggerListen(Trigger *const trigger,
 		   const char *const eventname,
 		   Listener *const listener);
@@ -90,8 +194,138 @@ int triggerUnlisten(Trigger *const trigger,
                     const char *const eventname,
                     Listener *const listener); /* return 1/0 on success/fail */
 
+/* bulk versions of triggerListen(): listen for several event types on one
+   trigger, or for one event type on several triggers.  These are cheaper
+   than the equivalent sequence of triggerListen() calls. */
+void triggerListenMany(Trigger *const trigger,
+		       const char *const *const eventnames,
+		       const int num_eventnames,
+		       Listener *const listener);
+void triggerListenMulti(Trigger *const *const triggers,
+			const int num_triggers,
+			const char *const eventname,
+			Listener *const listener);
+/* stop listening for everything, on every trigger.  The listener is not
+   deleted (or auto-deleted) and may be used to listen again. */
+void listenerUnlistenAll(Listener *const listener);
+
 void triggerEvent(Trigger *const trigger,
 		  const char *const eventname,
 		  const void *const eventdata);
+/* the same as calling triggerEvent() on each of the triggers in turn,
+   but quicker when there are too many of them to stay in the cache */
+void triggerEventMulti(Trigger *const *const triggers,
+		       const int num_triggers,
+		       const char *const eventname,
+		       const void *const eventdata);
+
+/* scheduled events: triggerEventAfter() arranges for the event to be
+   fired on the trigger by the triggerTick() call 'ticks' ticks from now
+   (a 'ticks' of 0 is treated as 1).  The 'eventdata_size' bytes at
+   'eventdata' are copied, so the payload may live on the stack; if
+   'eventdata_size' is 0 then the eventdata pointer itself is passed along
+   verbatim when the event fires.  Pending events are cancelled when their
+   trigger is deleted.  triggerEventAfter() returns a handle with which
+   triggerCancelTimer() can cancel that one event in constant time; like
+   the TriggerHandles below, it goes harmlessly stale once the event has
+   fired or been cancelled, so triggerCancelTimer() returns 1 only if the
+   event was still pending.  (The handle is TRIGGER_NULL_HANDLE if the
+   wheel already has more events pending than handles can count, though
+   the event is scheduled anyway.) */
+TriggerWheel* triggerWheelNew(void);
+void triggerWheelInit(TriggerWheel *const wheel);
+void triggerWheelDelete(TriggerWheel *const wheel); /* cancels pending */
+void triggerWheelDeleteInner(TriggerWheel *const wheel);
+
+TriggerTimerHandle triggerEventAfter(TriggerWheel *const wheel,
+				     Trigger *const trigger,
+				     const char *const eventname,
+				     const void *const eventdata,
+				     const size_t eventdata_size,
+				     const unsigned long ticks);
+int triggerCancelTimer(TriggerWheel *const wheel,
+		       const TriggerTimerHandle handle);
+void triggerTick(TriggerWheel *const wheel);
+int triggerCancelEvents(Trigger *const trigger,
+			const char *const eventname); /* NULL cancels all;
+							 returns number
+							 cancelled */
+
+
+/* Handles: an optional alternative to Trigger* and Listener* pointers,
+   made by creating triggers and listeners through a TriggerHandles table.
+   Looking up a handle whose object has since been deleted -- by any
+   means, including auto-deletion -- harmlessly yields NULL, and deleting
+   through such a handle does nothing, so it is always safe to delete an
+   auto-delete listener by its handle.  Objects made by handle calls may
+   still be used through their pointers as normal.  The table also keeps
+   its live objects densely packed for quick iteration: the
+   triggerHandlesTrigger()/listenerHandlesListener() index runs from 0 to
+   the respective count minus one, and the order changes on deletion. */
+TriggerHandles* triggerHandlesNew(void);
+void triggerHandlesInit(TriggerHandles *const handles);
+void triggerHandlesDelete(TriggerHandles *const handles); /* deletes all
+							     objects in
+							     the table */
+void triggerHandlesDeleteInner(TriggerHandles *const handles);
+
+TriggerHandle triggerHandleNew(TriggerHandles *const handles);
+Trigger* triggerHandleGet(const TriggerHandles *const handles,
+			  const TriggerHandle handle);
+void triggerHandleDelete(TriggerHandles *const handles,
+			 const TriggerHandle handle);
+TriggerHandle triggerGetHandle(const Trigger *const trigger);
+int triggerHandlesNumTriggers(const TriggerHandles *const handles);
+Trigger* triggerHandlesTrigger(const TriggerHandles *const handles,
+			       const int index);
+
+ListenerHandle listenerHandleNew(TriggerHandles *const handles);
+Listener* listenerHandleGet(const TriggerHandles *const handles,
+			    const ListenerHandle handle);
+void listenerHandleDelete(TriggerHandles *const handles,
+			  const ListenerHandle handle);
+ListenerHandle listenerGetHandle(const Listener *const listener);
+int listenerHandlesNumListeners(const TriggerHandles *const handles);
+Listener* listenerHandlesListener(const TriggerHandles *const handles,
+				  const int index);
+
+
+/* Snapshots of the trigger/listener graph, for quickly rebuilding it.
+   triggerGraphSave() writes the given triggers and listeners -- their
+   event slots, listener lists, parents, callbacks and auto-delete modes --
+   into 'buffer' in a compact, portable binary form, and returns the
+   number of bytes that needs (so call it with a NULL buffer to find out
+   how big a buffer to provide).  Callbacks are saved as indices into the
+   application's 'functions' table; links to triggers or listeners which
+   aren't in the given arrays are left out.  Listener data hooks and
+   scheduled events are not saved.
+
+   triggerGraphLoad() rebuilds the graph from a snapshot, which may simply
+   be a mmap()ed file, filling 'triggers' and 'listeners' (which must have
+   room for the counts reported by triggerGraphInfo()) in the order they
+   were saved.  The listeners' data hooks are set from 'listener_data',
+   which may be NULL.  Both return 0 if the snapshot is malformed or was
+   made with a different TRIGGER_TABLE_SIZE, in which case nothing is
+   created; triggerGraphLoad() also refuses snapshots whose parent links
+   form a loop, or which give one trigger two slots for the same name. */
+size_t triggerGraphSave(Trigger *const *const triggers,
+			const int num_triggers,
+			Listener *const *const listeners,
+			const int num_listeners,
+			LFunction *const *const functions,
+			const int num_functions,
+			void *const buffer,
+			const size_t buffer_size);
+int triggerGraphInfo(const void *const buffer,
+		     const size_t buffer_size,
+		     int *const num_triggers,
+		     int *const num_listeners); /* return 1/0 on success/fail */
+int triggerGraphLoad(const void *const buffer,
+		     const size_t buffer_size,
+		     LFunction *const *const functions,
+		     const int num_functions,
+		     void *const *const listener_data,
+		     Trigger **const triggers,
+		     Listener **const listeners); /* return 1/0 on success/fail */
 
 #endif